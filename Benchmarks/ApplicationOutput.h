@@ -0,0 +1,46 @@
+#pragma once
+
+// Helpers for the benchmarks that run VulkanTutorial as a separate process and read its output
+
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// Runs command through the shell and collects what it writes to stdout. Returns false if it could
+// not be started or exited with an error
+inline bool runCommand(const std::string& command, std::string& output) {
+	FILE* pipe = popen(command.c_str(), "r");
+	if (pipe == nullptr) {
+		return false;
+	}
+
+	output.clear();
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+		output.append(buffer, read);
+	}
+
+	return pclose(pipe) == 0;
+}
+
+// Reads the number in front of suffix on the line starting with prefix, or returns -1
+inline double findValue(const std::string& output, const std::string& prefix, const std::string& suffix) {
+	size_t line = output.find(prefix);
+	if (line == std::string::npos) {
+		return -1.0;
+	}
+
+	size_t end = output.find(suffix, line);
+	size_t lineEnd = output.find('\n', line);
+	if (end == std::string::npos || end > lineEnd) {
+		return -1.0;
+	}
+
+	size_t begin = output.find_last_of(" (", end - 1);
+	return std::stod(output.substr(begin + 1, end - begin - 1));
+}
@@ -0,0 +1,179 @@
+// Runs VulkanTutorial headless on a fixed timestep and a scripted camera path and reports its frame
+// time percentiles as JSON.
+//
+//   FrameTimeBenchmark <path/to/VulkanTutorial> [frames] [output.json] [application arguments...]
+//
+// The run uses --headless --frames <frames> --fixed-timestep 16.667 --camera-path orbit, so every
+// run renders the same frames whatever its speed, plus the remaining arguments. It is started from
+// the current directory, which must be one the application finds its assets from. Without a GPU,
+// point the loader at a software ICD, e.g. VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+// for lavapipe. The first WARMUP_FRAMES frames are left out of the statistics. GPU times need
+// timestamp support and are -1 without it.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ApplicationOutput.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+const size_t WARMUP_FRAMES = 10;
+
+// Milliseconds of simulated time per frame, 60 Hz
+const char* FIXED_TIMESTEP = "16.667";
+
+struct Statistics {
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+};
+
+// Nearest rank percentiles. Negative samples (unavailable) are ignored; all -1 without any
+Statistics computeStatistics(std::vector<double> samples) {
+	samples.erase(std::remove_if(samples.begin(), samples.end(), [](double sample) { return sample < 0.0; }), samples.end());
+	if (samples.empty()) {
+		return { -1.0, -1.0, -1.0, -1.0 };
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double sample : samples) {
+		sum += sample;
+	}
+
+	auto percentile = [&](size_t percent) {
+		return samples[std::min(samples.size() - 1, samples.size() * percent / 100)];
+	};
+
+	return { sum / samples.size(), percentile(50), percentile(95), percentile(99) };
+}
+
+void writeStatistics(std::ostream& out, const char* name, const Statistics& statistics) {
+	out << "  \"" << name << "\": { \"mean\": " << statistics.mean << ", \"p50\": " << statistics.p50
+		<< ", \"p95\": " << statistics.p95 << ", \"p99\": " << statistics.p99 << " }";
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: FrameTimeBenchmark <path/to/VulkanTutorial> [frames] [output.json] [application arguments...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string application = argv[1];
+	uint32_t frameCount = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 600;
+	std::string outputPath = argc > 3 ? argv[3] : "";
+
+	std::string arguments;
+	for (int i = 4; i < argc; i++) {
+		arguments += std::string(" ") + argv[i];
+	}
+
+	if (frameCount <= WARMUP_FRAMES) {
+		std::cerr << "at least " << (WARMUP_FRAMES + 1) << " frames are needed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Per frame samples the application writes with --frame-times, named after this process so
+	// benchmarks running side by side in one directory keep their own
+	std::string frameTimesPath = "FrameTimeBenchmark." + std::to_string(getpid()) + ".frames.txt";
+
+	try {
+		std::string command = "\"" + application + "\" --headless --frames " + std::to_string(frameCount) + " --fixed-timestep " + FIXED_TIMESTEP +
+			" --camera-path orbit --frame-times " + frameTimesPath + arguments + " 2>&1";
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		std::string output;
+		if (!runCommand(command, output)) {
+			std::remove(frameTimesPath.c_str());
+			throw std::runtime_error("run failed:\n" + output);
+		}
+
+		double processMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+		double startupMilliseconds = findValue(output, "startup:", " ms with");
+
+		std::vector<double> frameTimes;
+		std::vector<double> cpuTimes;
+		std::vector<double> gpuTimes;
+		{
+			std::ifstream file(frameTimesPath);
+			if (!file.is_open()) {
+				throw std::runtime_error("no frame times written by the run:\n" + output);
+			}
+
+			std::string line;
+			while (std::getline(file, line)) {
+				if (line.empty() || line[0] == '#') {
+					continue;
+				}
+
+				std::istringstream fields(line);
+				double frame, cpu, gpu;
+				if (!(fields >> frame >> cpu >> gpu)) {
+					throw std::runtime_error("malformed frame times line: " + line);
+				}
+
+				frameTimes.push_back(frame);
+				cpuTimes.push_back(cpu);
+				gpuTimes.push_back(gpu);
+			}
+		}
+		std::remove(frameTimesPath.c_str());
+
+		if (frameTimes.size() <= WARMUP_FRAMES) {
+			throw std::runtime_error("only " + std::to_string(frameTimes.size()) + " frames were written");
+		}
+
+		frameTimes.erase(frameTimes.begin(), frameTimes.begin() + WARMUP_FRAMES);
+		cpuTimes.erase(cpuTimes.begin(), cpuTimes.begin() + WARMUP_FRAMES);
+		gpuTimes.erase(gpuTimes.begin(), gpuTimes.begin() + WARMUP_FRAMES);
+
+		std::ostringstream json;
+		json << std::fixed << std::setprecision(3);
+		json << "{\n";
+		json << "  \"frames\": " << frameTimes.size() << ",\n";
+		json << "  \"warmup_frames\": " << WARMUP_FRAMES << ",\n";
+		json << "  \"fixed_timestep_ms\": " << FIXED_TIMESTEP << ",\n";
+		json << "  \"startup_ms\": " << startupMilliseconds << ",\n";
+		json << "  \"process_ms\": " << processMilliseconds << ",\n";
+		writeStatistics(json, "frame_ms", computeStatistics(frameTimes));
+		json << ",\n";
+		writeStatistics(json, "cpu_ms", computeStatistics(cpuTimes));
+		json << ",\n";
+		writeStatistics(json, "gpu_ms", computeStatistics(gpuTimes));
+		json << "\n}\n";
+
+		std::cout << json.str();
+
+		if (!outputPath.empty()) {
+			std::ofstream file(outputPath);
+			if (!file.is_open()) {
+				throw std::runtime_error("failed to open " + outputPath);
+			}
+			file << json.str();
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
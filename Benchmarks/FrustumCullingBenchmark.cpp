@@ -0,0 +1,159 @@
+// Compares culling a scene through SceneBvh against testing every object.
+//
+//   FrustumCullingBenchmark [iterations]
+//
+// Scenes of 10k, 100k and 1M randomly placed boxes are culled against a camera turning around the
+// middle of the scene. Every object moves a little before each frame, so each frame refits the
+// tree first. Both methods must find the same visible objects, otherwise the benchmark fails.
+
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+const float SCENE_SIZE = 1000.0f;
+
+// Column-major view projection of a camera at the origin turned by angle around the vertical axis,
+// with a 60 degree field of view and [0, 1] depth
+void makeViewProjection(float angle, float viewProjection[16]) {
+	const float nearPlane = 0.1f;
+	const float farPlane = SCENE_SIZE;
+	const float focal = 1.0f / std::tan(0.5f * 60.0f * 3.14159265f / 180.0f);
+	const float aspect = 16.0f / 9.0f;
+
+	float projection[16] = {};
+	projection[0] = focal / aspect;
+	projection[5] = -focal;
+	projection[10] = farPlane / (nearPlane - farPlane);
+	projection[11] = -1.0f;
+	projection[14] = nearPlane * farPlane / (nearPlane - farPlane);
+
+	float c = std::cos(angle), s = std::sin(angle);
+	float view[16] = {
+		c, 0.0f, -s, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		s, 0.0f, c, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	for (int column = 0; column < 4; column++) {
+		for (int row = 0; row < 4; row++) {
+			float sum = 0.0f;
+			for (int k = 0; k < 4; k++) {
+				sum += projection[4 * k + row] * view[4 * column + k];
+			}
+			viewProjection[4 * column + row] = sum;
+		}
+	}
+}
+
+std::vector<Aabb> makeScene(uint32_t objectCount, std::mt19937& random) {
+	std::uniform_real_distribution<float> position(-0.5f * SCENE_SIZE, 0.5f * SCENE_SIZE);
+	std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+	std::vector<Aabb> boxes(objectCount);
+	for (auto& box : boxes) {
+		for (int axis = 0; axis < 3; axis++) {
+			float center = position(random);
+			float extent = size(random);
+			box.min[axis] = center - extent;
+			box.max[axis] = center + extent;
+		}
+	}
+	return boxes;
+}
+
+void moveScene(std::vector<Aabb>& boxes, std::mt19937& random) {
+	std::uniform_real_distribution<float> offset(-0.1f, 0.1f);
+	for (auto& box : boxes) {
+		for (int axis = 0; axis < 3; axis++) {
+			float delta = offset(random);
+			box.min[axis] += delta;
+			box.max[axis] += delta;
+		}
+	}
+}
+
+double milliseconds(const std::function<void()>& work) {
+	auto start = std::chrono::high_resolution_clock::now();
+	work();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::chrono::milliseconds::period>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t iterations = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 20;
+	if (iterations == 0) {
+		std::cerr << "usage: FrustumCullingBenchmark [iterations]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		std::cout << std::setw(9) << "objects" << std::setw(10) << "visible" << std::setw(11) << "build ms" << std::setw(11) << "refit ms"
+			<< std::setw(11) << "bvh ms" << std::setw(13) << "bvh tests" << std::setw(13) << "brute ms" << std::setw(10) << "speedup" << std::endl;
+
+		for (uint32_t objectCount : { 10000u, 100000u, 1000000u }) {
+			std::mt19937 random(objectCount);
+			std::vector<Aabb> boxes = makeScene(objectCount, random);
+
+			SceneBvh bvh;
+			double buildTime = milliseconds([&]() { bvh.build(boxes); });
+
+			double refitTime = 0.0, bvhTime = 0.0, bruteTime = 0.0;
+			uint64_t visibleTotal = 0, bvhTests = 0;
+			std::vector<uint32_t> bvhVisible, bruteVisible;
+			bvhVisible.reserve(objectCount);
+			bruteVisible.reserve(objectCount);
+
+			for (uint32_t i = 0; i < iterations; i++) {
+				moveScene(boxes, random);
+
+				float viewProjection[16];
+				makeViewProjection(6.2831853f * i / iterations, viewProjection);
+				Frustum frustum = extractFrustum(viewProjection);
+
+				CullStats bvhStats, bruteStats;
+				bvhVisible.clear();
+				bruteVisible.clear();
+
+				refitTime += milliseconds([&]() { bvh.refit(boxes); });
+				bvhTime += milliseconds([&]() { bvh.cull(frustum, bvhVisible, bvhStats); });
+				bruteTime += milliseconds([&]() { cullBruteForce(frustum, boxes, bruteVisible, bruteStats); });
+
+				std::sort(bvhVisible.begin(), bvhVisible.end());
+				if (bvhVisible != bruteVisible) {
+					throw std::runtime_error("BVH and brute force culling disagree at " + std::to_string(objectCount) + " objects!");
+				}
+
+				visibleTotal += bvhStats.visibleCount;
+				bvhTests += bvhStats.boxesTested;
+			}
+
+			std::cout << std::fixed << std::setprecision(3)
+				<< std::setw(9) << objectCount
+				<< std::setw(10) << visibleTotal / iterations
+				<< std::setw(11) << buildTime
+				<< std::setw(11) << refitTime / iterations
+				<< std::setw(11) << bvhTime / iterations
+				<< std::setw(13) << bvhTests / iterations
+				<< std::setw(13) << bruteTime / iterations
+				<< std::setw(9) << std::setprecision(2) << bruteTime / bvhTime << "x"
+				<< std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+// Sweeps the instance count of headless VulkanTutorial runs and reports the frame time of each.
+//
+//   InstancingBenchmark <path/to/VulkanTutorial> [frames] [max instances] [application arguments...]
+//
+// Every run is a separate process with --headless --instances N --frames <frames> and the remaining
+// arguments, started from the current directory, which must be one the application finds its
+// assets from. The instance count goes 1, 10, 100, ... and then the maximum (100000 by default).
+// Comparing runs with and without --lod shows what the levels of detail save. With --gpu-culling
+// the device culls and picks the levels, so the triangle column is only the full detail upper bound.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ApplicationOutput.h"
+
+struct RunResult {
+	double millisecondsPerFrame;
+	double recordMillisecondsPerFrame;
+	double trianglesPerFrame;
+};
+
+RunResult runApplication(const std::string& application, uint32_t instanceCount, uint32_t frameCount, const std::string& arguments) {
+	std::string command = "\"" + application + "\" --headless --instances " + std::to_string(instanceCount) +
+		" --frames " + std::to_string(frameCount) + arguments + " 2>&1";
+
+	std::string output;
+	if (!runCommand(command, output)) {
+		throw std::runtime_error("run with " + std::to_string(instanceCount) + " instances failed:\n" + output);
+	}
+
+	RunResult result;
+	result.millisecondsPerFrame = findValue(output, "headless:", " ms/frame");
+	result.recordMillisecondsPerFrame = findValue(output, "recording:", " ms/frame");
+	result.trianglesPerFrame = findValue(output, "submitted:", " triangles/frame");
+	if (result.millisecondsPerFrame < 0.0) {
+		throw std::runtime_error("no frame time in the output of the run with " + std::to_string(instanceCount) + " instances:\n" + output);
+	}
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: InstancingBenchmark <path/to/VulkanTutorial> [frames] [max instances] [application arguments...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::string application = argv[1];
+	uint32_t frameCount = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 300;
+	uint32_t maxInstances = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 100000;
+
+	std::string arguments;
+	for (int i = 4; i < argc; i++) {
+		arguments += std::string(" ") + argv[i];
+	}
+
+	std::vector<uint32_t> instanceCounts;
+	for (uint32_t count = 1; count < maxInstances; count *= 10) {
+		instanceCounts.push_back(count);
+	}
+	instanceCounts.push_back(maxInstances);
+
+	try {
+		std::cout << std::setw(10) << "instances" << std::setw(12) << "ms/frame" << std::setw(10) << "fps"
+			<< std::setw(14) << "record ms" << std::setw(16) << "Minstances/s" << std::setw(14) << "tris/frame" << std::endl;
+
+		for (uint32_t instanceCount : instanceCounts) {
+			RunResult result = runApplication(application, instanceCount, frameCount, arguments);
+
+			std::cout << std::fixed << std::setprecision(3)
+				<< std::setw(10) << instanceCount
+				<< std::setw(12) << result.millisecondsPerFrame
+				<< std::setw(10) << std::setprecision(1) << (1000.0 / result.millisecondsPerFrame)
+				<< std::setw(14) << std::setprecision(3) << result.recordMillisecondsPerFrame
+				<< std::setw(16) << (instanceCount / (result.millisecondsPerFrame * 1000.0))
+				<< std::setw(14) << std::setprecision(0) << result.trianglesPerFrame
+				<< std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+// Measures the throughput of the CPU mip generator.
+//
+//   MipGeneratorBenchmark [iterations]
+//
+// Builds the full mip chain of synthetic RGBA8 images from 256x256 to 4096x4096 with each filter,
+// with and without sRGB-correct filtering, at 1, 2, 4, ... threads up to the hardware thread
+// count. Throughput is given in source megatexels (level 0) per second.
+
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+double bestOf(uint32_t iterations, std::vector<unsigned char>& chain, const std::vector<TextureLevel>& levels, const MipGenerationOptions& options) {
+	double best = std::numeric_limits<double>::max();
+	for (uint32_t i = 0; i < iterations; i++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		generateMipChain(chain.data(), levels, options);
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::chrono::milliseconds::period>(end - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t iterations = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 3;
+	unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << std::setw(10) << "size" << std::setw(8) << "filter" << std::setw(6) << "srgb" << std::setw(9) << "threads"
+		<< std::setw(12) << "ms" << std::setw(14) << "MTexel/s" << std::endl;
+
+	for (uint32_t size = 256; size <= 4096; size *= 2) {
+		std::vector<TextureLevel> levels;
+		std::vector<unsigned char> chain(static_cast<size_t>(layoutMipChain(size, size, VK_FORMAT_R8G8B8A8_UNORM, levels)));
+
+		// Smooth gradients with some noise, so neither filter sees flat input
+		uint32_t seed = 1;
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				seed = seed * 1664525u + 1013904223u;
+				unsigned char* texel = &chain[(static_cast<size_t>(y) * size + x) * 4];
+				texel[0] = static_cast<unsigned char>(x * 255 / size);
+				texel[1] = static_cast<unsigned char>(y * 255 / size);
+				texel[2] = static_cast<unsigned char>(seed >> 24);
+				texel[3] = 255;
+			}
+		}
+
+		for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser }) {
+			for (bool srgb : { false, true }) {
+				for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+					MipGenerationOptions options;
+					options.filter = filter;
+					options.srgb = srgb;
+					options.threadCount = threads;
+
+					double time = bestOf(iterations, chain, levels, options);
+					double megatexels = static_cast<double>(size) * size / 1e6;
+
+					std::cout << std::setw(10) << (std::to_string(size) + "^2") << std::setw(8) << (filter == MipFilter::Box ? "box" : "kaiser")
+						<< std::setw(6) << (srgb ? "yes" : "no") << std::setw(9) << threads
+						<< std::setw(12) << std::fixed << std::setprecision(2) << time
+						<< std::setw(14) << std::setprecision(1) << megatexels / (time / 1000.0) << std::endl;
+				}
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+// Compares tinyobj::LoadObj against LoadObjParallel on the same file.
+//
+//   ObjParserBenchmark <file.obj> [iterations]
+//
+// The parallel parser is timed at 1, 2, 4, ... threads up to the hardware thread count. Both
+// loaders must agree on the attribute and index counts, otherwise the benchmark fails.
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadResult {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+
+	size_t indexCount() const {
+		size_t count = 0;
+		for (const auto& shape : shapes) {
+			count += shape.mesh.indices.size();
+		}
+		return count;
+	}
+};
+
+double bestOf(uint32_t iterations, const std::function<void()>& load) {
+	double best = std::numeric_limits<double>::max();
+	for (uint32_t i = 0; i < iterations; i++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		load();
+		auto end = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::chrono::milliseconds::period>(end - start).count());
+	}
+	return best;
+}
+
+void checkEqual(const LoadResult& expected, const LoadResult& actual) {
+	if (expected.attrib.vertices.size() != actual.attrib.vertices.size() ||
+		expected.attrib.texcoords.size() != actual.attrib.texcoords.size() ||
+		expected.attrib.normals.size() != actual.attrib.normals.size() ||
+		expected.indexCount() != actual.indexCount()) {
+		throw std::runtime_error("parallel parser disagrees with tinyobj on element counts!");
+	}
+
+	for (size_t i = 0; i < expected.attrib.vertices.size(); i++) {
+		float a = expected.attrib.vertices[i];
+		float b = actual.attrib.vertices[i];
+		if (std::abs(a - b) > 1e-5f * std::max(1.0f, std::abs(a))) {
+			throw std::runtime_error("parallel parser disagrees with tinyobj on vertex " + std::to_string(i / 3) + "!");
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: ObjParserBenchmark <file.obj> [iterations]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const char* path = argv[1];
+	uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 3;
+
+	try {
+		LoadResult reference;
+		double tinyobjTime = bestOf(iterations, [&]() {
+			std::vector<tinyobj::material_t> materials;
+			std::string err;
+			reference = LoadResult();
+			if (!tinyobj::LoadObj(&reference.attrib, &reference.shapes, &materials, &err, path)) {
+				throw std::runtime_error(err);
+			}
+		});
+
+		std::cout << path << ": " << reference.attrib.vertices.size() / 3 << " positions, "
+			<< reference.indexCount() / 3 << " triangles, " << reference.shapes.size() << " shape(s)" << std::endl;
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "tinyobj::LoadObj          " << std::setw(10) << tinyobjTime << " ms" << std::endl;
+
+		unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+			LoadResult result;
+			double time = bestOf(iterations, [&]() {
+				std::string err;
+				result = LoadResult();
+				if (!LoadObjParallel(&result.attrib, &result.shapes, &err, path, threads)) {
+					throw std::runtime_error(err);
+				}
+			});
+			checkEqual(reference, result);
+
+			std::cout << "LoadObjParallel " << std::setw(2) << threads << " thread(s) " << std::setw(10) << time << " ms  ("
+				<< tinyobjTime / time << "x)" << std::endl;
+
+			if (threads == maxThreads) {
+				break;
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
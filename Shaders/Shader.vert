@@ -11,6 +11,10 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+// Per-instance model matrix (locations 3 to 6) and tint
+layout(location = 3) in mat4 inInstanceModel;
+layout(location = 7) in vec4 inInstanceTint;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
@@ -20,7 +24,7 @@ out gl_PerVertex {
 
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
+    gl_Position = ubo.proj * ubo.view * inInstanceModel * ubo.model * vec4(inPosition, 1.0);
+    fragColor = inColor * inInstanceTint.rgb;
 	fragTexCoord = inTexCoord;
 }
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	vec4 positionScale;
+	vec4 positionOffset;
+} ubo;
+
+// R16G16B16A16_UNORM position in the mesh bounds, R16G16_SFLOAT texture coordinate
+layout(location = 0) in vec4 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+
+// Per-instance model matrix (locations 3 to 6) and tint
+layout(location = 3) in mat4 inInstanceModel;
+layout(location = 7) in vec4 inInstanceTint;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+
+void main() {
+    vec3 position = ubo.positionOffset.xyz + ubo.positionScale.xyz * inPosition.xyz;
+    gl_Position = ubo.proj * ubo.view * inInstanceModel * ubo.model * vec4(position, 1.0);
+    fragColor = inInstanceTint.rgb;
+	fragTexCoord = inTexCoord;
+}
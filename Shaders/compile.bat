@@ -2,5 +2,7 @@ SET VULKAN_SDK=D:\sdk\VulkanSDK\1.1.73.0
 SET COMPILER=%VULKAN_SDK%\Bin32/glslangValidator.exe
 %COMPILER% -V Shader.vert
 %COMPILER% -V Shader.frag
+%COMPILER% -V ShaderCompact.vert -o compact_vert.spv
+%COMPILER% -V Cull.comp -o cull_comp.spv
 pause
 
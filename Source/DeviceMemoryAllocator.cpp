@@ -0,0 +1,324 @@
+#include "DeviceMemoryAllocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	double toMiB(VkDeviceSize bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	std::string describeMemoryProperties(VkMemoryPropertyFlags flags) {
+		std::string result;
+		if (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) result += "DEVICE_LOCAL ";
+		if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) result += "HOST_VISIBLE ";
+		if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) result += "HOST_COHERENT ";
+		if (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) result += "HOST_CACHED ";
+		if (!result.empty()) result.pop_back();
+		return result;
+	}
+}
+
+const VkDeviceSize DeviceMemoryAllocator::DEFAULT_BLOCK_SIZE;
+
+void DeviceMemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+	this->device = device;
+	this->blockSize = blockSize;
+
+	// Queried once here instead of on every findMemoryType call
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+	maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	blocksPerType.assign(memoryProperties.memoryTypeCount, std::vector<Block>());
+}
+
+void DeviceMemoryAllocator::destroy() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& blocks : blocksPerType) {
+		for (auto& block : blocks) {
+			destroyBlock(block);
+		}
+		blocks.clear();
+	}
+}
+
+uint32_t DeviceMemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+Allocation DeviceMemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationKind kind) {
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Allocation allocation;
+	auto& blocks = blocksPerType[memoryType];
+
+	// Resources larger than half a block get their own VkDeviceMemory instead of fragmenting the shared blocks
+	bool dedicated = requirements.size > blockSize / 2;
+
+	if (!dedicated) {
+		for (auto& block : blocks) {
+			if (!block.dedicated && allocateFromBlock(block, requirements, kind, allocation)) {
+				return allocation;
+			}
+		}
+	}
+
+	Block& block = createBlock(memoryType, dedicated ? requirements.size : blockSize, dedicated);
+	if (!allocateFromBlock(block, requirements, kind, allocation)) {
+		throw std::runtime_error("failed to sub-allocate from a new memory block!");
+	}
+
+	return allocation;
+}
+
+void DeviceMemoryAllocator::free(Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto& blocks = blocksPerType[allocation.memoryType];
+	auto blockIt = std::find_if(blocks.begin(), blocks.end(), [&](const Block& block) { return block.id == allocation.blockId; });
+	if (blockIt == blocks.end()) {
+		throw std::invalid_argument("freeing an allocation that does not belong to this allocator!");
+	}
+
+	Block& block = *blockIt;
+	auto& ranges = block.ranges;
+
+	auto it = std::lower_bound(ranges.begin(), ranges.end(), allocation.offset,
+		[](const Range& range, VkDeviceSize offset) { return range.offset < offset; });
+	if (it == ranges.end() || it->offset != allocation.offset || it->kind == AllocationKind::Free) {
+		throw std::invalid_argument("freeing an allocation that is not live!");
+	}
+
+	it->kind = AllocationKind::Free;
+	block.usedBytes -= it->size;
+	block.allocationCount--;
+
+	// Coalesce with the following and the preceding free range
+	auto next = it + 1;
+	if (next != ranges.end() && next->kind == AllocationKind::Free) {
+		it->size += next->size;
+		it = ranges.erase(next) - 1;
+	}
+	if (it != ranges.begin() && (it - 1)->kind == AllocationKind::Free) {
+		auto prev = it - 1;
+		prev->size += it->size;
+		ranges.erase(it);
+	}
+
+	allocation = Allocation();
+
+	if (block.allocationCount == 0) {
+		// Keep one empty shared block per memory type around to avoid allocate/free churn
+		bool keep = !block.dedicated && std::count_if(blocks.begin(), blocks.end(), [](const Block& other) {
+			return !other.dedicated && other.allocationCount == 0;
+		}) == 1;
+
+		if (!keep) {
+			destroyBlock(block);
+			blocks.erase(blockIt);
+		}
+	}
+}
+
+DeviceMemoryAllocator::Block& DeviceMemoryAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated) {
+	if (maxAllocationCount > 0 && deviceAllocationCount >= maxAllocationCount) {
+		throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+	}
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	Block block = {};
+	block.id = nextBlockId++;
+	block.memoryType = memoryType;
+	block.size = size;
+	block.dedicated = dedicated;
+
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory block!");
+	}
+
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		void* data;
+		if (vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+			vkFreeMemory(device, block.memory, nullptr);
+			throw std::runtime_error("failed to map device memory block!");
+		}
+		block.mapped = static_cast<uint8_t*>(data);
+	}
+
+	block.ranges.push_back({ 0, size, AllocationKind::Free });
+
+	deviceAllocationCount++;
+	peakDeviceAllocationCount = std::max(peakDeviceAllocationCount, deviceAllocationCount);
+
+	auto& blocks = blocksPerType[memoryType];
+	blocks.push_back(std::move(block));
+	return blocks.back();
+}
+
+bool DeviceMemoryAllocator::conflictsOnPage(VkDeviceSize endA, AllocationKind kindA, VkDeviceSize startB, AllocationKind kindB) const {
+	if (kindA == AllocationKind::Free || kindB == AllocationKind::Free || kindA == kindB) {
+		return false;
+	}
+
+	VkDeviceSize pageMask = ~(bufferImageGranularity - 1);
+	return ((endA - 1) & pageMask) == (startB & pageMask);
+}
+
+bool DeviceMemoryAllocator::allocateFromBlock(Block& block, const VkMemoryRequirements& requirements, AllocationKind kind, Allocation& allocation) {
+	if (block.size - block.usedBytes < requirements.size) {
+		return false;
+	}
+
+	auto& ranges = block.ranges;
+	size_t bestIndex = ranges.size();
+	VkDeviceSize bestOffset = 0;
+
+	for (size_t i = 0; i < ranges.size(); i++) {
+		const Range& range = ranges[i];
+		if (range.kind != AllocationKind::Free || range.size < requirements.size) {
+			continue;
+		}
+
+		VkDeviceSize offset = alignUp(range.offset, std::max<VkDeviceSize>(requirements.alignment, 1));
+
+		// Move to the next granularity page if a resource of the other kind ends on our first page
+		for (size_t j = i; j > 0; j--) {
+			const Range& prev = ranges[j - 1];
+			if (prev.kind == AllocationKind::Free) continue;
+			if (((prev.offset + prev.size - 1) & ~(bufferImageGranularity - 1)) != (offset & ~(bufferImageGranularity - 1))) break;
+			if (conflictsOnPage(prev.offset + prev.size, prev.kind, offset, kind)) {
+				offset = alignUp(offset, bufferImageGranularity);
+				break;
+			}
+		}
+
+		VkDeviceSize end = offset + requirements.size;
+		if (end > range.offset + range.size) {
+			continue;
+		}
+
+		// Reject the range if a resource of the other kind starts on our last page
+		bool conflict = false;
+		for (size_t j = i + 1; j < ranges.size(); j++) {
+			const Range& next = ranges[j];
+			if (next.kind == AllocationKind::Free) continue;
+			if (((end - 1) & ~(bufferImageGranularity - 1)) != (next.offset & ~(bufferImageGranularity - 1))) break;
+			if (conflictsOnPage(end, kind, next.offset, next.kind)) {
+				conflict = true;
+				break;
+			}
+		}
+		if (conflict) {
+			continue;
+		}
+
+		if (bestIndex == ranges.size() || range.size < ranges[bestIndex].size) {
+			bestIndex = i;
+			bestOffset = offset;
+		}
+	}
+
+	if (bestIndex == ranges.size()) {
+		return false;
+	}
+
+	// Split the chosen free range into [padding][allocation][remainder]
+	Range chosen = ranges[bestIndex];
+	VkDeviceSize padding = bestOffset - chosen.offset;
+	VkDeviceSize remainder = chosen.offset + chosen.size - (bestOffset + requirements.size);
+
+	std::vector<Range> replacement;
+	if (padding > 0) replacement.push_back({ chosen.offset, padding, AllocationKind::Free });
+	replacement.push_back({ bestOffset, requirements.size, kind });
+	if (remainder > 0) replacement.push_back({ bestOffset + requirements.size, remainder, AllocationKind::Free });
+
+	ranges.erase(ranges.begin() + bestIndex);
+	ranges.insert(ranges.begin() + bestIndex, replacement.begin(), replacement.end());
+
+	block.usedBytes += requirements.size;
+	block.allocationCount++;
+	totalSubAllocations++;
+
+	allocation.memory = block.memory;
+	allocation.offset = bestOffset;
+	allocation.size = requirements.size;
+	allocation.mapped = block.mapped != nullptr ? block.mapped + bestOffset : nullptr;
+	allocation.memoryType = block.memoryType;
+	allocation.blockId = block.id;
+
+	return true;
+}
+
+void DeviceMemoryAllocator::destroyBlock(Block& block) {
+	if (block.mapped != nullptr) {
+		vkUnmapMemory(device, block.memory);
+	}
+	vkFreeMemory(device, block.memory, nullptr);
+
+	block.memory = VK_NULL_HANDLE;
+	block.mapped = nullptr;
+	deviceAllocationCount--;
+}
+
+void DeviceMemoryAllocator::printStats(std::ostream& out) const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	out << "device memory: " << deviceAllocationCount << " live vkAllocateMemory blocks (peak " << peakDeviceAllocationCount
+		<< ", limit " << maxAllocationCount << "), " << totalSubAllocations << " sub-allocations served" << std::endl;
+
+	out << std::fixed << std::setprecision(2);
+	for (uint32_t type = 0; type < blocksPerType.size(); type++) {
+		const auto& blocks = blocksPerType[type];
+		if (blocks.empty()) continue;
+
+		VkDeviceSize reserved = 0, used = 0, largestFree = 0;
+		uint32_t allocations = 0, freeRanges = 0, dedicatedBlocks = 0;
+		for (const auto& block : blocks) {
+			reserved += block.size;
+			used += block.usedBytes;
+			allocations += block.allocationCount;
+			if (block.dedicated) dedicatedBlocks++;
+
+			for (const auto& range : block.ranges) {
+				if (range.kind == AllocationKind::Free) {
+					freeRanges++;
+					largestFree = std::max(largestFree, range.size);
+				}
+			}
+		}
+
+		const VkMemoryType& memoryType = memoryProperties.memoryTypes[type];
+		out << "  type " << type << " (heap " << memoryType.heapIndex << ", " << describeMemoryProperties(memoryType.propertyFlags) << "): "
+			<< blocks.size() << " blocks (" << dedicatedBlocks << " dedicated), " << toMiB(reserved) << " MiB reserved, "
+			<< toMiB(used) << " MiB used by " << allocations << " allocations, " << freeRanges << " free ranges (largest "
+			<< toMiB(largestFree) << " MiB)" << std::endl;
+	}
+	out.unsetf(std::ios::floatfield);
+}
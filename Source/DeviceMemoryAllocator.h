@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Kind of resource bound to a sub-allocation. Linear and optimal resources that share a
+// bufferImageGranularity page must not be placed next to each other.
+enum class AllocationKind : uint8_t {
+	Free,
+	Linear,		// Buffers and linearly tiled images
+	Optimal		// Optimally tiled images
+};
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	// Host pointer to the start of the allocation when the memory type is host visible
+	void* mapped = nullptr;
+
+	uint32_t memoryType = 0;
+	uint32_t blockId = 0;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one list of blocks per
+// memory type. Free space is tracked per block as an offset-ordered list of ranges that is
+// searched best-fit and coalesced on free. Host visible blocks stay mapped for their lifetime.
+class DeviceMemoryAllocator {
+public:
+	static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+	void destroy();
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationKind kind);
+	void free(Allocation& allocation);
+
+	const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const {
+		return memoryProperties;
+	}
+
+	void printStats(std::ostream& out) const;
+
+private:
+	struct Range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		AllocationKind kind;
+	};
+
+	struct Block {
+		uint32_t id;
+		uint32_t memoryType;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint8_t* mapped;
+		bool dedicated;
+
+		// Covers the whole block, sorted by offset, adjacent free ranges are always merged
+		std::vector<Range> ranges;
+		VkDeviceSize usedBytes;
+		uint32_t allocationCount;
+	};
+
+	Block& createBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+	bool allocateFromBlock(Block& block, const VkMemoryRequirements& requirements, AllocationKind kind, Allocation& allocation);
+	void destroyBlock(Block& block);
+
+	bool conflictsOnPage(VkDeviceSize endA, AllocationKind kindA, VkDeviceSize startB, AllocationKind kindB) const;
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize bufferImageGranularity = 1;
+	VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+	uint32_t maxAllocationCount = 0;
+
+	std::vector<std::vector<Block>> blocksPerType;
+	uint32_t nextBlockId = 1;
+
+	uint32_t deviceAllocationCount = 0;
+	uint32_t peakDeviceAllocationCount = 0;
+	uint64_t totalSubAllocations = 0;
+
+	mutable std::mutex mutex;
+};
@@ -0,0 +1,180 @@
+#include "FileUtils.h"
+
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool getFileStatus(const std::string& path, FileStatus& status) {
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) {
+		return false;
+	}
+
+	status.size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	status.modifiedTime = static_cast<int64_t>((static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+		attributes.ftLastWriteTime.dwLowDateTime);
+	return true;
+}
+
+#else
+
+bool getFileStatus(const std::string& path, FileStatus& status) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+
+	status.size = static_cast<uint64_t>(info.st_size);
+#ifdef __APPLE__
+	status.modifiedTime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	status.modifiedTime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+#endif
+
+bool writeFileAtomically(const std::string& path, const std::vector<FileChunk>& chunks) {
+	std::string temporaryPath = path + ".tmp";
+
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	bool written = true;
+	for (const auto& chunk : chunks) {
+		if (chunk.size > 0 && fwrite(chunk.data, 1, chunk.size, file) != chunk.size) {
+			written = false;
+			break;
+		}
+	}
+
+	written = written && fflush(file) == 0;
+#ifdef _WIN32
+	written = written && _commit(_fileno(file)) == 0;
+#else
+	written = written && fsync(fileno(file)) == 0;
+#endif
+	written = fclose(file) == 0 && written;
+
+	if (!written) {
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	if (!MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+	if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+#endif
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+namespace {
+
+// Overwrites size bytes at offset of an existing file in place. Unlike writeFileAtomically a crash
+// can leave the bytes torn, so this is only for fields that are verified on read anyway
+bool patchFile(const std::string& path, uint64_t offset, const void* data, size_t size) {
+	FILE* file = fopen(path.c_str(), "r+b");
+	if (file == nullptr) {
+		return false;
+	}
+
+	bool written = fseek(file, static_cast<long>(offset), SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+	written = fclose(file) == 0 && written;
+	return written;
+}
+
+inline uint64_t mix64(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xFF51AFD7ED558CCDull;
+	x ^= x >> 33;
+	x *= 0xC4CEB9FE1A85EC53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+inline uint64_t rotateLeft(uint64_t x, int bits) {
+	return (x << bits) | (x >> (64 - bits));
+}
+
+} // namespace
+
+uint64_t hashBytes(const void* data, size_t size) {
+	const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+	const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t lanes[4] = { PRIME1, PRIME2, ~PRIME1, ~PRIME2 };
+
+	size_t offset = 0;
+	for (; offset + 32 <= size; offset += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t word;
+			memcpy(&word, bytes + offset + lane * 8, sizeof(word));
+			lanes[lane] = rotateLeft(lanes[lane] + word * PRIME2, 31) * PRIME1;
+		}
+	}
+
+	uint64_t hash = static_cast<uint64_t>(size) * PRIME1;
+	for (int lane = 0; lane < 4; lane++) {
+		hash = mix64(hash ^ lanes[lane]);
+	}
+
+	for (; offset < size; offset += 8) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + offset, size - offset < 8 ? size - offset : 8);
+		hash = mix64(hash ^ (word * PRIME1));
+	}
+
+	return hash;
+}
+
+bool hashFile(const std::string& path, uint64_t& hash) {
+	MappedFile file;
+	if (!file.open(path)) {
+		return false;
+	}
+
+	hash = hashBytes(file.data(), file.size());
+	return true;
+}
+
+bool isCacheSourceCurrent(const std::string& cachePath, uint64_t modifiedTimeOffset, const std::string& sourcePath,
+	uint64_t sourceSize, int64_t sourceModifiedTime, uint64_t sourceHash) {
+	FileStatus status;
+	if (!getFileStatus(sourcePath, status) || status.size != sourceSize) {
+		return false;
+	}
+	if (status.modifiedTime == sourceModifiedTime) {
+		return true;
+	}
+
+	// The source was touched or replaced. It is only stale if its contents changed
+	uint64_t hash;
+	if (!hashFile(sourcePath, hash) || hash != sourceHash) {
+		return false;
+	}
+
+	patchFile(cachePath, modifiedTimeOffset, &status.modifiedTime, sizeof(status.modifiedTime));
+	return true;
+}
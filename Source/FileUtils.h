@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FileStatus {
+	uint64_t size;
+	// Last modification time in platform ticks. Only meaningful when compared for equality
+	int64_t modifiedTime;
+};
+
+bool getFileStatus(const std::string& path, FileStatus& status);
+
+struct FileChunk {
+	const void* data;
+	size_t size;
+};
+
+// Writes the chunks back to back into a temporary file next to path, flushes it to disk and
+// renames it over path, so readers never observe a partially written file
+bool writeFileAtomically(const std::string& path, const std::vector<FileChunk>& chunks);
+
+// 64-bit content hash for change detection (not cryptographic). Processes four independent
+// 64-bit lanes so hashing large files runs at memory speed
+uint64_t hashBytes(const void* data, size_t size);
+
+// hashBytes of the whole file, read through a mapping
+bool hashFile(const std::string& path, uint64_t& hash);
+
+// Checks the source a cache file was built from against the size, modification time and hash the
+// cache recorded. A source that was only touched (new time, same contents) still matches, and its
+// new time is then written into the cache at modifiedTimeOffset so later checks skip the hash. The
+// cache may be mapped meanwhile; a failed write only means hashing again next time
+bool isCacheSourceCurrent(const std::string& cachePath, uint64_t modifiedTimeOffset, const std::string& sourcePath,
+	uint64_t sourceSize, int64_t sourceModifiedTime, uint64_t sourceHash);
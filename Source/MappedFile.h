@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is released when the object is destroyed.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false (and leaves the object closed) if the file cannot be opened or mapped
+	bool open(const std::string& path);
+	void close();
+
+	const char* data() const {
+		return static_cast<const char*>(view);
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	bool isOpen() const {
+		return opened;
+	}
+
+private:
+	void* view = nullptr;
+	size_t length = 0;
+
+	// Empty files cannot be mapped but still open successfully
+	bool opened = false;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
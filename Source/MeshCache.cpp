@@ -0,0 +1,192 @@
+#include "MeshCache.h"
+
+#include "FileUtils.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+const char MESH_CACHE_MAGIC[4] = { 'V', 'M', 'S', 'H' };
+const uint32_t MAX_CACHED_ATTRIBUTES = 8;
+
+// Blobs start at this alignment so they can be read in place from the mapping
+const uint64_t BLOB_ALIGNMENT = 16;
+
+struct MeshCacheAttribute {
+	uint32_t location;
+	uint32_t binding;
+	uint32_t format;
+	uint32_t offset;
+};
+
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+	uint64_t sourceHash;
+
+	uint32_t vertexStride;
+	uint32_t attributeCount;
+	MeshCacheAttribute attributes[MAX_CACHED_ATTRIBUTES];
+
+	uint64_t vertexCount;
+	uint64_t vertexOffset;
+	uint64_t indexCount;
+	uint64_t indexOffset;
+	uint64_t sourceCornerCount;
+
+	float positionScale[3];
+	float positionOffset[3];
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	uint32_t lodCount;
+	MeshLod lods[MAX_MESH_LODS];
+
+	uint64_t meshletCount;
+	uint64_t meshletOffset;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool layoutMatches(const MeshCacheHeader& header, const MeshLayout& layout) {
+	if (header.vertexStride != layout.vertexStride || header.attributeCount != layout.attributes.size()) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.attributeCount; i++) {
+		const MeshCacheAttribute& cached = header.attributes[i];
+		const VkVertexInputAttributeDescription& expected = layout.attributes[i];
+		if (cached.location != expected.location || cached.binding != expected.binding ||
+			cached.format != static_cast<uint32_t>(expected.format) || cached.offset != expected.offset) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace
+
+bool MeshCache::open(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout) {
+	close();
+
+	if (!file.open(cachePath) || file.size() < sizeof(MeshCacheHeader)) {
+		close();
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	bool valid = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0 && header.version == VERSION &&
+		layoutMatches(header, layout) &&
+		header.vertexOffset % BLOB_ALIGNMENT == 0 && header.indexOffset % BLOB_ALIGNMENT == 0 &&
+		header.vertexOffset <= file.size() && header.indexOffset <= file.size() &&
+		header.vertexCount <= (file.size() - header.vertexOffset) / header.vertexStride &&
+		header.indexCount <= (file.size() - header.indexOffset) / sizeof(uint32_t) &&
+		header.meshletOffset % BLOB_ALIGNMENT == 0 && header.meshletOffset <= file.size() &&
+		header.meshletCount <= (file.size() - header.meshletOffset) / sizeof(Meshlet) &&
+		header.lodCount <= MAX_MESH_LODS;
+
+	for (uint32_t i = 0; valid && i < header.lodCount; i++) {
+		const MeshLod& lod = header.lods[i];
+		valid = lod.firstIndex <= header.indexCount && lod.indexCount <= header.indexCount - lod.firstIndex &&
+			lod.firstMeshlet <= header.meshletCount && lod.meshletCount <= header.meshletCount - lod.firstMeshlet;
+	}
+
+	valid = valid && isCacheSourceCurrent(cachePath, offsetof(MeshCacheHeader, sourceModifiedTime), sourcePath,
+		header.sourceSize, header.sourceModifiedTime, header.sourceHash);
+
+	if (!valid) {
+		close();
+		return false;
+	}
+
+	view.vertices = file.data() + header.vertexOffset;
+	view.vertexCount = header.vertexCount;
+	view.vertexStride = header.vertexStride;
+	view.indices = reinterpret_cast<const uint32_t*>(file.data() + header.indexOffset);
+	view.indexCount = header.indexCount;
+	view.sourceCornerCount = header.sourceCornerCount;
+	memcpy(view.positionScale, header.positionScale, sizeof(view.positionScale));
+	memcpy(view.positionOffset, header.positionOffset, sizeof(view.positionOffset));
+	memcpy(view.boundsMin, header.boundsMin, sizeof(view.boundsMin));
+	memcpy(view.boundsMax, header.boundsMax, sizeof(view.boundsMax));
+	view.lodCount = header.lodCount;
+	memcpy(view.lods, header.lods, sizeof(view.lods));
+	view.meshlets = reinterpret_cast<const Meshlet*>(file.data() + header.meshletOffset);
+	view.meshletCount = header.meshletCount;
+	return true;
+}
+
+void MeshCache::close() {
+	file.close();
+	view = MeshView();
+}
+
+bool MeshCache::write(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout, const MeshView& mesh) {
+	if (layout.attributes.size() > MAX_CACHED_ATTRIBUTES || mesh.vertexStride != layout.vertexStride) {
+		return false;
+	}
+
+	FileStatus sourceStatus;
+	// Zeroed including the padding in front of meshletCount, so equal meshes give identical files
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	if (!getFileStatus(sourcePath, sourceStatus) || !hashFile(sourcePath, header.sourceHash)) {
+		return false;
+	}
+
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = VERSION;
+	header.sourceSize = sourceStatus.size;
+	header.sourceModifiedTime = sourceStatus.modifiedTime;
+
+	header.vertexStride = layout.vertexStride;
+	header.attributeCount = static_cast<uint32_t>(layout.attributes.size());
+	for (size_t i = 0; i < layout.attributes.size(); i++) {
+		header.attributes[i].location = layout.attributes[i].location;
+		header.attributes[i].binding = layout.attributes[i].binding;
+		header.attributes[i].format = static_cast<uint32_t>(layout.attributes[i].format);
+		header.attributes[i].offset = layout.attributes[i].offset;
+	}
+
+	uint64_t vertexBytes = mesh.vertexCount * mesh.vertexStride;
+	uint64_t indexBytes = mesh.indexCount * sizeof(uint32_t);
+	uint64_t meshletBytes = mesh.meshletCount * sizeof(Meshlet);
+
+	header.vertexCount = mesh.vertexCount;
+	header.vertexOffset = alignUp(sizeof(MeshCacheHeader), BLOB_ALIGNMENT);
+	header.indexCount = mesh.indexCount;
+	header.indexOffset = alignUp(header.vertexOffset + vertexBytes, BLOB_ALIGNMENT);
+	header.sourceCornerCount = mesh.sourceCornerCount;
+	memcpy(header.positionScale, mesh.positionScale, sizeof(header.positionScale));
+	memcpy(header.positionOffset, mesh.positionOffset, sizeof(header.positionOffset));
+	memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+	header.lodCount = mesh.lodCount;
+	memcpy(header.lods, mesh.lods, sizeof(header.lods));
+	header.meshletCount = mesh.meshletCount;
+	header.meshletOffset = alignUp(header.indexOffset + indexBytes, BLOB_ALIGNMENT);
+
+	static const char padding[BLOB_ALIGNMENT] = {};
+
+	std::vector<FileChunk> chunks = {
+		{ &header, sizeof(header) },
+		{ padding, static_cast<size_t>(header.vertexOffset - sizeof(header)) },
+		{ mesh.vertices, static_cast<size_t>(vertexBytes) },
+		{ padding, static_cast<size_t>(header.indexOffset - header.vertexOffset - vertexBytes) },
+		{ mesh.indices, static_cast<size_t>(indexBytes) },
+		{ padding, static_cast<size_t>(header.meshletOffset - header.indexOffset - indexBytes) },
+		{ mesh.meshlets, static_cast<size_t>(meshletBytes) }
+	};
+
+	return writeFileAtomically(cachePath, chunks);
+}
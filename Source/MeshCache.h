@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+
+const uint32_t MAX_MESH_LODS = 8;
+
+// Range of the index array holding one level of detail
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// Estimated distance in model space between this level's surface and full detail (0 for level 0)
+	float error;
+	// Range of MeshView::meshlets covering the level's indices
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+// Vertex and index arrays of an imported mesh. The arrays either belong to the importer or point
+// into a mapped mesh cache file.
+struct MeshView {
+	const void* vertices = nullptr;
+	uint64_t vertexCount = 0;
+	uint32_t vertexStride = 0;
+
+	const uint32_t* indices = nullptr;
+	uint64_t indexCount = 0;
+
+	// Face corners in the source file, i.e. the vertex count before welding
+	uint64_t sourceCornerCount = 0;
+
+	// Quantized layouts store positions in [0, 1]. The model space position is offset + scale * stored
+	float positionScale[3] = { 1.0f, 1.0f, 1.0f };
+	float positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+
+	// Model space bounding box of the positions
+	float boundsMin[3] = { 0.0f, 0.0f, 0.0f };
+	float boundsMax[3] = { 0.0f, 0.0f, 0.0f };
+
+	// Levels of detail from full detail down, all indexing the same vertices. Together they cover
+	// the index array
+	uint32_t lodCount = 0;
+	MeshLod lods[MAX_MESH_LODS] = {};
+
+	// Clusters of every level, with index ranges relative to the whole index array
+	const Meshlet* meshlets = nullptr;
+	uint64_t meshletCount = 0;
+};
+
+struct MeshLayout {
+	uint32_t vertexStride;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+};
+
+// Cooked binary copy of an imported mesh:
+//
+//   MeshCacheHeader | vertex blob | index blob | meshlet blob
+//
+// The header records the vertex layout the blobs were written with and the size, modification
+// time and content hash of the source file. A cache whose layout or version differs is ignored.
+// A cache whose source size or time differs is only accepted if the source still hashes the same.
+class MeshCache {
+public:
+	// Version 2: meshes are stored optimized for the vertex cache and vertex fetch
+	// Version 3: position dequantization scale and offset
+	// Version 4: mesh bounding box
+	// Version 5: levels of detail
+	// Version 6: meshlets
+	// Version 7: meshlet triangles ordered for the vertex cache
+	static const uint32_t VERSION = 7;
+
+	// Maps cachePath and validates it against sourcePath and layout. On success getView() points
+	// into the mapping, which stays valid until close() or destruction
+	bool open(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout);
+	void close();
+
+	const MeshView& getView() const {
+		return view;
+	}
+
+	static bool write(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout, const MeshView& mesh);
+
+private:
+	MappedFile file;
+	MeshView view;
+};
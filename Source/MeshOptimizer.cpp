@@ -0,0 +1,1025 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+// Triangles that use each vertex, as a compressed adjacency list
+struct TriangleAdjacency {
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> counts;
+	std::vector<uint32_t> triangles;
+
+	TriangleAdjacency(const uint32_t* indices, size_t indexCount, size_t vertexCount)
+		: offsets(vertexCount, 0), counts(vertexCount, 0), triangles(indexCount) {
+
+		for (size_t i = 0; i < indexCount; i++) {
+			counts[indices[i]]++;
+		}
+
+		uint32_t offset = 0;
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v] = offset;
+			offset += counts[v];
+		}
+
+		std::vector<uint32_t> fill(offsets);
+		for (size_t i = 0; i < indexCount; i++) {
+			triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+};
+
+// FIFO cache simulation shared by the analysis and the cluster splitting
+class FifoCache {
+public:
+	FifoCache(size_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) {
+	}
+
+	// Returns the number of misses (0-3) for one triangle
+	uint32_t addTriangle(const uint32_t* triangle) {
+		uint32_t misses = 0;
+		for (int i = 0; i < 3; i++) {
+			uint32_t v = triangle[i];
+			if (time - timestamps[v] > cacheSize) {
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	void flush() {
+		// Pushing the clock past the cache size evicts everything
+		time += cacheSize + 1;
+	}
+
+private:
+	std::vector<uint32_t> timestamps;
+	uint32_t cacheSize;
+	uint32_t time;
+};
+
+float triangleArea(const float* a, const float* b, const float* c, float normal[3]) {
+	float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	return 0.5f * std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		misses += cache.addTriangle(&indices[i]);
+		for (int j = 0; j < 3; j++) {
+			if (!referenced[indices[i + j]]) {
+				referenced[indices[i + j]] = true;
+				uniqueVertices++;
+			}
+		}
+	}
+
+	VertexCacheStats stats = {};
+	stats.acmr = indexCount >= 3 ? static_cast<float>(misses) / static_cast<float>(indexCount / 3) : 0.0f;
+	stats.atvr = uniqueVertices > 0 ? static_cast<float>(misses) / static_cast<float>(uniqueVertices) : 0.0f;
+	return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize) {
+
+	std::vector<uint32_t> clusters;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return clusters;
+	}
+
+	// destination may alias indices
+	std::vector<uint32_t> source(indices, indices + indexCount);
+
+	TriangleAdjacency adjacency(source.data(), indexCount, vertexCount);
+	std::vector<uint32_t> liveTriangles(adjacency.counts);
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	deadEnds.reserve(indexCount);
+	candidates.reserve(64);
+
+	uint32_t timestamp = cacheSize + 1;
+	size_t cursor = 0;
+	size_t outputTriangles = 0;
+
+	// Next vertex in input order that still has live triangles
+	auto skipDeadEnd = [&]() -> uint32_t {
+		while (!deadEnds.empty()) {
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0) {
+				return vertex;
+			}
+		}
+
+		for (; cursor < vertexCount; cursor++) {
+			if (liveTriangles[cursor] > 0) {
+				return static_cast<uint32_t>(cursor);
+			}
+		}
+
+		return INVALID_INDEX;
+	};
+
+	uint32_t fanningVertex = skipDeadEnd();
+	bool coldStart = true;
+
+	while (fanningVertex != INVALID_INDEX) {
+		candidates.clear();
+
+		uint32_t begin = adjacency.offsets[fanningVertex];
+		uint32_t end = begin + adjacency.counts[fanningVertex];
+
+		for (uint32_t t = begin; t < end; t++) {
+			uint32_t triangle = adjacency.triangles[t];
+			if (emitted[triangle]) {
+				continue;
+			}
+
+			if (coldStart) {
+				clusters.push_back(static_cast<uint32_t>(outputTriangles));
+				coldStart = false;
+			}
+
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t vertex = source[triangle * 3 + corner];
+				destination[outputTriangles * 3 + corner] = vertex;
+
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				if (timestamp - cacheTimestamps[vertex] > cacheSize) {
+					cacheTimestamps[vertex] = timestamp++;
+				}
+			}
+
+			emitted[triangle] = true;
+			outputTriangles++;
+		}
+
+		// Prefer the candidate that is still in the cache and will stay there while its remaining
+		// triangles are emitted, picking the oldest such vertex
+		uint32_t next = INVALID_INDEX;
+		int bestPriority = -1;
+		for (uint32_t vertex : candidates) {
+			if (liveTriangles[vertex] == 0) {
+				continue;
+			}
+
+			int priority = 0;
+			if (timestamp - cacheTimestamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+				priority = static_cast<int>(timestamp - cacheTimestamps[vertex]);
+			}
+
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		if (next == INVALID_INDEX) {
+			next = skipDeadEnd();
+			// A vertex from the input cursor is unrelated to anything in the cache
+			coldStart = next != INVALID_INDEX && timestamp - cacheTimestamps[next] > cacheSize;
+		}
+
+		fanningVertex = next;
+	}
+
+	return clusters;
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters,
+	const void* positions, size_t positionStride, float threshold, uint32_t cacheSize) {
+
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || clusters.empty()) {
+		return;
+	}
+
+	uint32_t vertexCount = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		vertexCount = std::max(vertexCount, indices[i] + 1);
+	}
+
+	// Soft boundaries: inside each hard cluster, cut wherever the running ACMR (with a cold cache
+	// at the cut) is already within threshold of the whole cluster's ACMR
+	std::vector<uint32_t> softClusters;
+	std::vector<uint32_t> triangleMisses(triangleCount);
+	{
+		FifoCache cache(vertexCount, cacheSize);
+		for (size_t c = 0; c < clusters.size(); c++) {
+			cache.flush();
+			size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			for (size_t t = clusters[c]; t < end; t++) {
+				triangleMisses[t] = cache.addTriangle(&indices[t * 3]);
+			}
+		}
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t c = 0; c < clusters.size(); c++) {
+		size_t begin = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+		uint32_t clusterMisses = 0;
+		for (size_t t = begin; t < end; t++) {
+			clusterMisses += triangleMisses[t];
+		}
+		float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+		cache.flush();
+		softClusters.push_back(static_cast<uint32_t>(begin));
+		uint32_t runningMisses = 0;
+		uint32_t runningTriangles = 0;
+
+		for (size_t t = begin; t < end; t++) {
+			runningMisses += cache.addTriangle(&indices[t * 3]);
+			runningTriangles++;
+
+			if (t + 1 < end && static_cast<float>(runningMisses) <= clusterThreshold * static_cast<float>(runningTriangles)) {
+				softClusters.push_back(static_cast<uint32_t>(t + 1));
+				cache.flush();
+				runningMisses = 0;
+				runningTriangles = 0;
+			}
+		}
+	}
+
+	// Area weighted centroid and normal of every cluster and of the whole mesh
+	const unsigned char* positionBytes = static_cast<const unsigned char*>(positions);
+	auto position = [&](uint32_t vertex) {
+		return reinterpret_cast<const float*>(positionBytes + static_cast<size_t>(vertex) * positionStride);
+	};
+
+	struct ClusterInfo {
+		uint32_t begin;
+		uint32_t end;
+		float centroid[3];
+		float normal[3];
+		float sortKey;
+	};
+
+	std::vector<ClusterInfo> infos(softClusters.size());
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < softClusters.size(); c++) {
+		ClusterInfo& info = infos[c];
+		info.begin = softClusters[c];
+		info.end = c + 1 < softClusters.size() ? softClusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+		float area = 0.0f;
+		float centroid[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+
+		for (uint32_t t = info.begin; t < info.end; t++) {
+			const float* a = position(indices[t * 3 + 0]);
+			const float* b = position(indices[t * 3 + 1]);
+			const float* d = position(indices[t * 3 + 2]);
+
+			float faceNormal[3];
+			float faceArea = triangleArea(a, b, d, faceNormal);
+
+			for (int k = 0; k < 3; k++) {
+				centroid[k] += (a[k] + b[k] + d[k]) * (faceArea / 3.0f);
+				// The cross product length is twice the area, so this is already area weighted
+				normal[k] += faceNormal[k];
+			}
+			area += faceArea;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			meshCentroid[k] += centroid[k];
+			info.centroid[k] = area > 0.0f ? centroid[k] / area : 0.0f;
+		}
+		meshArea += area;
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int k = 0; k < 3; k++) {
+			info.normal[k] = length > 0.0f ? normal[k] / length : 0.0f;
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		meshCentroid[k] = meshArea > 0.0f ? meshCentroid[k] / meshArea : 0.0f;
+	}
+
+	for (auto& info : infos) {
+		info.sortKey = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			info.sortKey += (info.centroid[k] - meshCentroid[k]) * info.normal[k];
+		}
+	}
+
+	std::stable_sort(infos.begin(), infos.end(), [](const ClusterInfo& a, const ClusterInfo& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> source(indices, indices + indexCount);
+	size_t output = 0;
+	for (const auto& info : infos) {
+		size_t count = (info.end - info.begin) * 3;
+		memcpy(&indices[output], &source[info.begin * 3], count * sizeof(uint32_t));
+		output += count;
+	}
+}
+
+size_t optimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t vertexStride) {
+	std::vector<uint32_t> remap(vertexCount, INVALID_INDEX);
+	uint32_t nextVertex = 0;
+
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t& target = remap[indices[i]];
+		if (target == INVALID_INDEX) {
+			target = nextVertex++;
+		}
+		indices[i] = target;
+	}
+
+	unsigned char* bytes = static_cast<unsigned char*>(vertices);
+	std::vector<unsigned char> source(bytes, bytes + vertexCount * vertexStride);
+
+	for (size_t v = 0; v < vertexCount; v++) {
+		if (remap[v] != INVALID_INDEX) {
+			memcpy(bytes + remap[v] * vertexStride, &source[v * vertexStride], vertexStride);
+		}
+	}
+
+	return nextVertex;
+}
+
+namespace {
+
+// What a vertex may collapse into, from its position's neighborhood. Seam vertices share their
+// position with exactly one other vertex (an attribute seam, e.g. texture coordinates), border
+// vertices lie on an open edge of the surface
+enum class VertexKind {
+	Manifold,
+	Border,
+	Seam,
+	Locked
+};
+
+// Sum of squared distances to weighted planes: p^T A p + 2 b^T p + c, with A symmetric
+struct Quadric {
+	double a00, a11, a22, a10, a20, a21;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	void addPlane(const double normal[3], double distance, double planeWeight) {
+		a00 += planeWeight * normal[0] * normal[0];
+		a11 += planeWeight * normal[1] * normal[1];
+		a22 += planeWeight * normal[2] * normal[2];
+		a10 += planeWeight * normal[1] * normal[0];
+		a20 += planeWeight * normal[2] * normal[0];
+		a21 += planeWeight * normal[2] * normal[1];
+		b0 += planeWeight * normal[0] * distance;
+		b1 += planeWeight * normal[1] * distance;
+		b2 += planeWeight * normal[2] * distance;
+		c += planeWeight * distance * distance;
+		weight += planeWeight;
+	}
+
+	void add(const Quadric& other) {
+		a00 += other.a00; a11 += other.a11; a22 += other.a22;
+		a10 += other.a10; a20 += other.a20; a21 += other.a21;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	// Weighted mean squared distance of p to the planes
+	double error(const float p[3]) const {
+		double x = p[0], y = p[1], z = p[2];
+		double sum = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a10 * x * y + a20 * x * z + a21 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0.0 ? std::abs(sum) / weight : 0.0;
+	}
+};
+
+// Border edges constrain the surface much less than its faces, so their quadrics are weighted up to
+// keep open boundaries in place
+const double BORDER_WEIGHT = 10.0;
+
+struct Collapse {
+	uint32_t source;
+	uint32_t target;
+	float error;
+};
+
+class Simplifier {
+public:
+	Simplifier(const uint32_t* indices, size_t indexCount, const void* positionData, size_t vertexCount, size_t positionStride)
+		: vertexCount(vertexCount), positions(vertexCount * 3), remap(vertexCount), wedge(vertexCount),
+		kinds(vertexCount, VertexKind::Manifold), openNext(vertexCount, INVALID_INDEX), openPrevious(vertexCount, INVALID_INDEX),
+		quadrics(vertexCount, Quadric()) {
+
+		const unsigned char* bytes = static_cast<const unsigned char*>(positionData);
+		for (size_t v = 0; v < vertexCount; v++) {
+			memcpy(&positions[v * 3], bytes + v * positionStride, 3 * sizeof(float));
+		}
+
+		buildPositionRemap();
+		classifyVertices(indices, indexCount);
+		buildQuadrics(indices, indexCount);
+	}
+
+	// Collapses edges of the cheapest error first until the mesh has at most targetIndexCount indices
+	// or the next collapse would exceed errorLimit. Returns the index count written to destination
+	size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float errorLimit, float& resultError) {
+		std::vector<uint32_t> current(indices, indices + indexCount);
+		resultError = 0.0f;
+
+		std::vector<uint32_t> collapseRemap(vertexCount);
+		std::vector<bool> collapseLocked(vertexCount);
+		std::vector<Collapse> candidates;
+
+		while (current.size() > targetIndexCount) {
+			TriangleAdjacency adjacency(current.data(), current.size(), vertexCount);
+
+			gatherCollapses(current, candidates);
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			for (uint32_t v = 0; v < vertexCount; v++) {
+				collapseRemap[v] = v;
+			}
+			std::fill(collapseLocked.begin(), collapseLocked.end(), false);
+
+			// A manifold collapse removes two triangles. Stopping at the goal keeps the last pass from overshooting
+			size_t collapseGoal = (current.size() - targetIndexCount) / 6 + 1;
+			size_t collapses = 0;
+
+			for (const Collapse& collapse : candidates) {
+				if (collapses >= collapseGoal || collapse.error > errorLimit) {
+					break;
+				}
+
+				uint32_t source = collapse.source;
+				uint32_t target = collapse.target;
+				uint32_t sourceTwin = INVALID_INDEX, targetTwin = INVALID_INDEX;
+				if (kinds[source] == VertexKind::Seam) {
+					sourceTwin = wedge[source];
+					targetTwin = findSeamTwinTarget(sourceTwin, target);
+				}
+
+				if (collapseLocked[source] || collapseLocked[target] ||
+					(sourceTwin != INVALID_INDEX && (collapseLocked[sourceTwin] || collapseLocked[targetTwin]))) {
+					continue;
+				}
+
+				if (flipsTriangles(adjacency, current, collapseRemap, source, target) ||
+					(sourceTwin != INVALID_INDEX && flipsTriangles(adjacency, current, collapseRemap, sourceTwin, targetTwin))) {
+					continue;
+				}
+
+				quadrics[remap[target]].add(quadrics[remap[source]]);
+
+				collapseRemap[source] = target;
+				collapseLocked[source] = collapseLocked[target] = true;
+				joinOpenEdges(source, target);
+				if (sourceTwin != INVALID_INDEX) {
+					collapseRemap[sourceTwin] = targetTwin;
+					joinOpenEdges(sourceTwin, targetTwin);
+					collapseLocked[sourceTwin] = collapseLocked[targetTwin] = true;
+				}
+
+				resultError = std::max(resultError, collapse.error);
+				collapses++;
+			}
+
+			if (collapses == 0) {
+				break;
+			}
+
+			// Apply the pass and drop the triangles that lost an edge
+			size_t output = 0;
+			for (size_t i = 0; i < current.size(); i += 3) {
+				uint32_t a = collapseRemap[current[i]], b = collapseRemap[current[i + 1]], c = collapseRemap[current[i + 2]];
+				if (a != b && b != c && c != a) {
+					current[output++] = a;
+					current[output++] = b;
+					current[output++] = c;
+				}
+			}
+			current.resize(output);
+		}
+
+		std::copy(current.begin(), current.end(), destination);
+		return current.size();
+	}
+
+private:
+	size_t vertexCount;
+	std::vector<float> positions;
+
+	// First vertex with the same position, and the next one in the cycle of vertices sharing it
+	std::vector<uint32_t> remap;
+	std::vector<uint32_t> wedge;
+
+	std::vector<VertexKind> kinds;
+	// Ends of the open edge leaving and entering border and seam vertices
+	std::vector<uint32_t> openNext;
+	std::vector<uint32_t> openPrevious;
+
+	// Indexed by remap, so the vertices of a position share one
+	std::vector<Quadric> quadrics;
+
+	const float* position(uint32_t v) const {
+		return &positions[v * 3];
+	}
+
+	void buildPositionRemap() {
+		struct PositionKey {
+			float x, y, z;
+			uint32_t vertex;
+		};
+
+		std::vector<PositionKey> keys(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			keys[v] = { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2], v };
+		}
+		std::sort(keys.begin(), keys.end(), [](const PositionKey& a, const PositionKey& b) {
+			return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : (a.z != b.z ? a.z < b.z : a.vertex < b.vertex));
+		});
+
+		for (size_t begin = 0; begin < keys.size();) {
+			size_t end = begin + 1;
+			while (end < keys.size() && keys[end].x == keys[begin].x && keys[end].y == keys[begin].y && keys[end].z == keys[begin].z) {
+				end++;
+			}
+
+			for (size_t i = begin; i < end; i++) {
+				remap[keys[i].vertex] = keys[begin].vertex;
+				wedge[keys[i].vertex] = keys[i + 1 < end ? i + 1 : begin].vertex;
+			}
+			begin = end;
+		}
+	}
+
+	static bool hasEdge(const TriangleAdjacency& adjacency, const uint32_t* indices, uint32_t from, uint32_t to) {
+		for (uint32_t i = 0; i < adjacency.counts[from]; i++) {
+			const uint32_t* triangle = &indices[adjacency.triangles[adjacency.offsets[from] + i] * 3];
+			for (int corner = 0; corner < 3; corner++) {
+				if (triangle[corner] == from && triangle[(corner + 1) % 3] == to) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// Whether any vertex at the position of from has an edge to a vertex at the position of to
+	bool hasPositionEdge(const TriangleAdjacency& adjacency, const uint32_t* indices, uint32_t from, uint32_t to) const {
+		uint32_t v = from;
+		do {
+			for (uint32_t i = 0; i < adjacency.counts[v]; i++) {
+				const uint32_t* triangle = &indices[adjacency.triangles[adjacency.offsets[v] + i] * 3];
+				for (int corner = 0; corner < 3; corner++) {
+					if (triangle[corner] == v && remap[triangle[(corner + 1) % 3]] == remap[to]) {
+						return true;
+					}
+				}
+			}
+			v = wedge[v];
+		} while (v != from);
+		return false;
+	}
+
+	void classifyVertices(const uint32_t* indices, size_t indexCount) {
+		TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+
+		std::vector<uint32_t> openOut(vertexCount, 0), openIn(vertexCount, 0);
+		std::vector<bool> onBorder(vertexCount, false);
+
+		for (size_t i = 0; i < indexCount; i++) {
+			uint32_t from = indices[i];
+			uint32_t to = indices[i - i % 3 + (i + 1) % 3];
+			if (hasEdge(adjacency, indices, to, from)) {
+				continue;
+			}
+
+			openOut[from]++;
+			openIn[to]++;
+			openNext[from] = to;
+			openPrevious[to] = from;
+
+			if (!hasPositionEdge(adjacency, indices, to, from)) {
+				onBorder[from] = onBorder[to] = true;
+			}
+		}
+
+		for (uint32_t v = 0; v < vertexCount; v++) {
+			bool singleOpenEdge = openOut[v] == 1 && openIn[v] == 1;
+			uint32_t twin = wedge[v];
+
+			if (twin == v) {
+				kinds[v] = openOut[v] == 0 && openIn[v] == 0 ? VertexKind::Manifold : (singleOpenEdge ? VertexKind::Border : VertexKind::Locked);
+			}
+			else if (wedge[twin] == v && singleOpenEdge && openOut[twin] == 1 && openIn[twin] == 1 && !onBorder[v] && !onBorder[twin]) {
+				kinds[v] = VertexKind::Seam;
+			}
+			else {
+				kinds[v] = VertexKind::Locked;
+			}
+		}
+	}
+
+	void buildQuadrics(const uint32_t* indices, size_t indexCount) {
+		for (size_t i = 0; i < indexCount; i += 3) {
+			const float* p[3] = { position(indices[i]), position(indices[i + 1]), position(indices[i + 2]) };
+
+			float normal[3];
+			double area = triangleArea(p[0], p[1], p[2], normal);
+			double length = 2.0 * area;
+			if (length <= 0.0) {
+				continue;
+			}
+
+			double unit[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+			double distance = -(unit[0] * p[0][0] + unit[1] * p[0][1] + unit[2] * p[0][2]);
+
+			Quadric quadric = {};
+			quadric.addPlane(unit, distance, area);
+			for (int corner = 0; corner < 3; corner++) {
+				quadrics[remap[indices[i + corner]]].add(quadric);
+			}
+
+			// Open edges of the surface get a plane through the edge, perpendicular to the face
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t from = indices[i + corner];
+				uint32_t to = indices[i + (corner + 1) % 3];
+				if (kinds[from] != VertexKind::Border || openNext[from] != to) {
+					continue;
+				}
+
+				double edge[3] = { p[(corner + 1) % 3][0] - p[corner][0], p[(corner + 1) % 3][1] - p[corner][1], p[(corner + 1) % 3][2] - p[corner][2] };
+				double edgeLength = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+				if (edgeLength <= 0.0) {
+					continue;
+				}
+
+				double perpendicular[3] = {
+					edge[1] * unit[2] - edge[2] * unit[1],
+					edge[2] * unit[0] - edge[0] * unit[2],
+					edge[0] * unit[1] - edge[1] * unit[0]
+				};
+				for (double& component : perpendicular) {
+					component /= edgeLength;
+				}
+				double edgeDistance = -(perpendicular[0] * p[corner][0] + perpendicular[1] * p[corner][1] + perpendicular[2] * p[corner][2]);
+
+				Quadric edgeQuadric = {};
+				edgeQuadric.addPlane(perpendicular, edgeDistance, edgeLength * edgeLength * BORDER_WEIGHT);
+				quadrics[remap[from]].add(edgeQuadric);
+				quadrics[remap[to]].add(edgeQuadric);
+			}
+		}
+	}
+
+	// Border and seam vertices may only slide along their open edges, locked vertices never move
+	bool canCollapse(uint32_t source, uint32_t target) const {
+		switch (kinds[source]) {
+		case VertexKind::Manifold:
+			return true;
+		case VertexKind::Border:
+			return (openNext[source] == target || openPrevious[source] == target) &&
+				(kinds[target] == VertexKind::Border || kinds[target] == VertexKind::Locked);
+		case VertexKind::Seam:
+			return (openNext[source] == target || openPrevious[source] == target) &&
+				(kinds[target] == VertexKind::Seam || kinds[target] == VertexKind::Locked) &&
+				findSeamTwinTarget(wedge[source], target) != INVALID_INDEX;
+		default:
+			return false;
+		}
+	}
+
+	// The other side of a seam collapses along its own open edge to the vertex at target's position
+	uint32_t findSeamTwinTarget(uint32_t sourceTwin, uint32_t target) const {
+		if (openNext[sourceTwin] != INVALID_INDEX && remap[openNext[sourceTwin]] == remap[target]) {
+			return openNext[sourceTwin];
+		}
+		if (openPrevious[sourceTwin] != INVALID_INDEX && remap[openPrevious[sourceTwin]] == remap[target]) {
+			return openPrevious[sourceTwin];
+		}
+		return INVALID_INDEX;
+	}
+
+	// Links the open edge on the far side of a collapsing border or seam vertex to the target
+	void joinOpenEdges(uint32_t source, uint32_t target) {
+		if (kinds[source] == VertexKind::Manifold) {
+			return;
+		}
+
+		if (openNext[source] == target) {
+			uint32_t previous = openPrevious[source];
+			if (previous != INVALID_INDEX) {
+				openNext[previous] = target;
+			}
+			openPrevious[target] = previous;
+		}
+		else {
+			uint32_t next = openNext[source];
+			if (next != INVALID_INDEX) {
+				openPrevious[next] = target;
+			}
+			openNext[target] = next;
+		}
+	}
+
+	float collapseError(uint32_t source, uint32_t target) const {
+		Quadric merged = quadrics[remap[source]];
+		merged.add(quadrics[remap[target]]);
+		return static_cast<float>(std::sqrt(merged.error(position(target))));
+	}
+
+	void gatherCollapses(const std::vector<uint32_t>& indices, std::vector<Collapse>& candidates) const {
+		candidates.clear();
+		for (size_t i = 0; i < indices.size(); i++) {
+			uint32_t a = indices[i];
+			uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+
+			// Interior edges are seen from both triangles, so only one of them adds the candidate
+			bool open = openNext[a] == b;
+			if (!open && a > b) {
+				continue;
+			}
+
+			Collapse best = { INVALID_INDEX, INVALID_INDEX, std::numeric_limits<float>::max() };
+			if (canCollapse(a, b)) {
+				best = { a, b, collapseError(a, b) };
+			}
+			if (canCollapse(b, a)) {
+				float error = collapseError(b, a);
+				if (error < best.error) {
+					best = { b, a, error };
+				}
+			}
+
+			if (best.source != INVALID_INDEX) {
+				candidates.push_back(best);
+			}
+		}
+	}
+
+	// Whether moving source onto target turns any remaining triangle around source over
+	bool flipsTriangles(const TriangleAdjacency& adjacency, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& collapseRemap,
+		uint32_t source, uint32_t target) const {
+		for (uint32_t i = 0; i < adjacency.counts[source]; i++) {
+			const uint32_t* triangle = &indices[adjacency.triangles[adjacency.offsets[source] + i] * 3];
+
+			uint32_t corners[3];
+			int sourceCorner = 0;
+			bool collapses = false;
+			for (int corner = 0; corner < 3; corner++) {
+				corners[corner] = collapseRemap[triangle[corner]];
+				if (triangle[corner] == source) {
+					sourceCorner = corner;
+				}
+				collapses = collapses || corners[corner] == target;
+			}
+
+			// Triangles on the collapsed edge disappear
+			if (collapses) {
+				continue;
+			}
+
+			float before[3], after[3];
+			const float* p1 = position(corners[(sourceCorner + 1) % 3]);
+			const float* p2 = position(corners[(sourceCorner + 2) % 3]);
+			triangleArea(position(source), p1, p2, before);
+			triangleArea(position(target), p1, p2, after);
+
+			if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0f) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+} // namespace
+
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const void* positions, size_t vertexCount,
+	size_t positionStride, size_t targetIndexCount, float errorLimit, float* resultError) {
+	Simplifier simplifier(indices, indexCount, positions, vertexCount, positionStride);
+
+	float error;
+	size_t count = simplifier.simplify(destination, indices, indexCount, targetIndexCount, errorLimit, error);
+	if (resultError != nullptr) {
+		*resultError = error;
+	}
+	return count;
+}
+
+namespace {
+
+const float* vertexPosition(const void* positions, size_t positionStride, uint32_t v) {
+	return reinterpret_cast<const float*>(static_cast<const unsigned char*>(positions) + v * positionStride);
+}
+
+// Fills in the bounding sphere and normal cone of a meshlet whose triangles are in place
+void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const void* positions, size_t positionStride) {
+	const uint32_t* triangles = indices + meshlet.firstIndex;
+	size_t cornerCount = meshlet.triangleCount * 3;
+
+	float minimum[3], maximum[3];
+	for (int axis = 0; axis < 3; axis++) {
+		minimum[axis] = std::numeric_limits<float>::max();
+		maximum[axis] = -std::numeric_limits<float>::max();
+	}
+	for (size_t i = 0; i < cornerCount; i++) {
+		const float* p = vertexPosition(positions, positionStride, triangles[i]);
+		for (int axis = 0; axis < 3; axis++) {
+			minimum[axis] = std::min(minimum[axis], p[axis]);
+			maximum[axis] = std::max(maximum[axis], p[axis]);
+		}
+	}
+
+	float radiusSquared = 0.0f;
+	for (int axis = 0; axis < 3; axis++) {
+		meshlet.center[axis] = 0.5f * (minimum[axis] + maximum[axis]);
+	}
+	for (size_t i = 0; i < cornerCount; i++) {
+		const float* p = vertexPosition(positions, positionStride, triangles[i]);
+		float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(radiusSquared);
+
+	// The axis is the mean of the unit normals, the cone must contain all of them
+	std::vector<float> normals(cornerCount);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t t = 0; t < meshlet.triangleCount; t++) {
+		float* normal = &normals[t * 3];
+		float area = triangleArea(vertexPosition(positions, positionStride, triangles[t * 3]), vertexPosition(positions, positionStride, triangles[t * 3 + 1]),
+			vertexPosition(positions, positionStride, triangles[t * 3 + 2]), normal);
+		float length = 2.0f * area;
+		for (int i = 0; i < 3; i++) {
+			normal[i] = length > 0.0f ? normal[i] / length : 0.0f;
+			axis[i] += normal[i];
+		}
+	}
+
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float minimumDot = 1.0f;
+	for (int i = 0; i < 3; i++) {
+		axis[i] = axisLength > 0.0f ? axis[i] / axisLength : 0.0f;
+		meshlet.coneAxis[i] = axis[i];
+		meshlet.coneApex[i] = meshlet.center[i];
+	}
+	for (size_t t = 0; t < meshlet.triangleCount; t++) {
+		const float* normal = &normals[t * 3];
+		minimumDot = std::min(minimumDot, normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]);
+	}
+
+	if (axisLength <= 0.0f || minimumDot <= 0.0f) {
+		meshlet.coneCutoff = 2.0f;
+		return;
+	}
+
+	// Move the apex back along the axis until it is behind every triangle's plane, so seeing the
+	// apex from behind the cone means seeing every triangle from behind
+	float apexDistance = 0.0f;
+	for (size_t t = 0; t < meshlet.triangleCount; t++) {
+		const float* normal = &normals[t * 3];
+		const float* p = vertexPosition(positions, positionStride, triangles[t * 3]);
+		float towardsCenter = (meshlet.center[0] - p[0]) * normal[0] + (meshlet.center[1] - p[1]) * normal[1] + (meshlet.center[2] - p[2]) * normal[2];
+		float alongAxis = normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2];
+		if (alongAxis > 0.0f) {
+			apexDistance = std::max(apexDistance, towardsCenter / alongAxis);
+		}
+	}
+
+	for (int i = 0; i < 3; i++) {
+		meshlet.coneApex[i] = meshlet.center[i] - axis[i] * apexDistance;
+	}
+	meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+}
+
+} // namespace
+
+std::vector<Meshlet> buildMeshlets(uint32_t* destination, const uint32_t* indices, size_t indexCount, const void* positions, size_t vertexCount,
+	size_t positionStride, size_t maxVertices, size_t maxTriangles) {
+
+	std::vector<Meshlet> meshlets;
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || maxVertices < 3 || maxTriangles == 0) {
+		return meshlets;
+	}
+
+	// destination may alias indices
+	std::vector<uint32_t> source(indices, indices + indexCount);
+	TriangleAdjacency adjacency(source.data(), indexCount, vertexCount);
+
+	std::vector<float> normals(triangleCount * 3);
+	for (size_t t = 0; t < triangleCount; t++) {
+		float* normal = &normals[t * 3];
+		float length = 2.0f * triangleArea(vertexPosition(positions, positionStride, source[t * 3]), vertexPosition(positions, positionStride, source[t * 3 + 1]),
+			vertexPosition(positions, positionStride, source[t * 3 + 2]), normal);
+		for (int i = 0; i < 3; i++) {
+			normal[i] = length > 0.0f ? normal[i] / length : 0.0f;
+		}
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	// Meshlet a vertex was last added to, plus one
+	std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> candidates;
+	meshletVertices.reserve(maxVertices);
+
+	size_t output = 0;
+	size_t seed = 0;
+	while (output < indexCount) {
+		while (emitted[seed]) {
+			seed++;
+		}
+
+		Meshlet meshlet = {};
+		meshlet.firstIndex = static_cast<uint32_t>(output);
+		uint32_t stamp = static_cast<uint32_t>(meshlets.size() + 1);
+		float normalSum[3] = { 0.0f, 0.0f, 0.0f };
+		meshletVertices.clear();
+
+		uint32_t triangle = static_cast<uint32_t>(seed);
+		while (triangle != INVALID_INDEX) {
+			emitted[triangle] = true;
+			meshlet.triangleCount++;
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t v = source[triangle * 3 + corner];
+				destination[output++] = v;
+				if (vertexMeshlet[v] != stamp) {
+					vertexMeshlet[v] = stamp;
+					meshletVertices.push_back(v);
+				}
+			}
+			for (int axis = 0; axis < 3; axis++) {
+				normalSum[axis] += normals[triangle * 3 + axis];
+			}
+
+			if (meshlet.triangleCount == maxTriangles) {
+				break;
+			}
+
+			// Pick the next triangle among the unemitted neighbors of the meshlet's vertices
+			triangle = INVALID_INDEX;
+			uint32_t bestNewVertices = 4;
+			float bestFacing = -std::numeric_limits<float>::max();
+			for (uint32_t v : meshletVertices) {
+				for (uint32_t i = 0; i < adjacency.counts[v]; i++) {
+					uint32_t candidate = adjacency.triangles[adjacency.offsets[v] + i];
+					if (emitted[candidate]) {
+						continue;
+					}
+
+					uint32_t newVertices = 0;
+					for (int corner = 0; corner < 3; corner++) {
+						newVertices += vertexMeshlet[source[candidate * 3 + corner]] != stamp;
+					}
+					if (meshletVertices.size() + newVertices > maxVertices || newVertices > bestNewVertices) {
+						continue;
+					}
+
+					const float* normal = &normals[candidate * 3];
+					float facing = normal[0] * normalSum[0] + normal[1] * normalSum[1] + normal[2] * normalSum[2];
+					if (newVertices < bestNewVertices || facing > bestFacing) {
+						triangle = candidate;
+						bestNewVertices = newVertices;
+						bestFacing = facing;
+					}
+				}
+			}
+		}
+
+		meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+		computeMeshletBounds(meshlet, destination, positions, positionStride);
+		meshlets.push_back(meshlet);
+	}
+
+	return meshlets;
+}
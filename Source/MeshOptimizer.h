@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Entries of the simulated post-transform vertex cache (FIFO), in the range of current hardware
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+	// Average cache miss ratio: vertex shader invocations per triangle (0.5 is the ideal for large grids)
+	float acmr;
+	// Average transformed vertex ratio: invocations per referenced vertex (1.0 is ideal)
+	float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post-transform cache reuse with Tipsify (Sander, Nehab and Barczak 2007).
+// Returns the index of the first triangle of every cluster, i.e. every point where the reordered
+// stream restarts with a cold cache. Clusters can be reordered freely without hurting the cache.
+std::vector<uint32_t> optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Splits the clusters further wherever that costs less than threshold times their ACMR and sorts
+// them so clusters that face away from the mesh center (likely occluders) are drawn first.
+// positions points at the first vertex position (three floats), positionStride is in bytes.
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters,
+	const void* positions, size_t positionStride, float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Moves vertices into the order the index buffer first references them and rewrites the indices.
+// Unreferenced vertices are dropped. Returns the new vertex count.
+size_t optimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount, size_t vertexCount, size_t vertexStride);
+
+// Reduces a triangle list to at most targetIndexCount indices by collapsing edges in order of their
+// quadric error (Garland and Heckbert 1997), stopping early once the next collapse would move the
+// surface further than errorLimit. Vertices collapse onto existing vertices, so the result indexes
+// the same vertex buffer. Open borders and attribute seams only collapse along themselves.
+// destination may alias indices. Returns the written index count; resultError receives the largest
+// collapse error in position units, i.e. the root of the mean squared distance to the source faces
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const void* positions, size_t vertexCount,
+	size_t positionStride, size_t targetIndexCount, float errorLimit, float* resultError = nullptr);
+
+// Limits of a meshlet, sized for mesh shading hardware: 64 vertices and 124 triangles keep a
+// cluster's primitive indices within 128 * 3 bytes with room for a header
+const size_t MAX_MESHLET_VERTICES = 64;
+const size_t MAX_MESHLET_TRIANGLES = 124;
+
+// A cluster of neighboring triangles, stored contiguously in the index buffer, with the bounds used
+// to cull it as a whole
+struct Meshlet {
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+	uint32_t vertexCount;
+
+	// Bounding sphere of the cluster's vertices
+	float center[3];
+	float radius;
+
+	// Normal cone: the cluster faces away from every camera position p for which
+	// dot(normalize(coneApex - p), coneAxis) >= coneCutoff. The cutoff is above 1 when the
+	// normals spread too far for the cluster to ever face away as a whole
+	float coneApex[3];
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+// Reorders a triangle list into meshlets of at most maxVertices unique vertices and maxTriangles
+// triangles. Each meshlet grows from the first remaining triangle of the input order through
+// triangles adjacent to it, preferring those that add the fewest vertices and then those facing
+// its way, so meshlets stay compact and their normal cones narrow. destination may alias indices.
+// Meshlet index ranges are relative to destination
+std::vector<Meshlet> buildMeshlets(uint32_t* destination, const uint32_t* indices, size_t indexCount, const void* positions, size_t vertexCount,
+	size_t positionStride, size_t maxVertices = MAX_MESHLET_VERTICES, size_t maxTriangles = MAX_MESHLET_TRIANGLES);
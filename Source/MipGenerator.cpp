@@ -0,0 +1,284 @@
+#include "MipGenerator.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIP_GENERATOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const uint32_t BYTES_PER_TEXEL = 4;
+
+// Destination texels along each side of the tiles a level is split into
+const uint32_t TILE_SIZE = 64;
+
+// Buckets of the linear to sRGB table
+const int SRGB_BUCKETS = 4096;
+
+// Source texels covered by each destination texel of the Kaiser filter along each axis
+const int KAISER_TAPS = 6;
+
+// One RGBA texel in linear floating point. The filters only ever scale and add whole texels, so a
+// single 128-bit register holds all four channels
+#if defined(MIP_GENERATOR_SSE2)
+typedef __m128 Texel;
+
+inline Texel loadTexel(const float* values) { return _mm_loadu_ps(values); }
+inline void storeTexel(float* values, Texel texel) { _mm_storeu_ps(values, texel); }
+inline Texel zeroTexel() { return _mm_setzero_ps(); }
+inline Texel multiplyAdd(Texel sum, Texel texel, float weight) { return _mm_add_ps(sum, _mm_mul_ps(texel, _mm_set1_ps(weight))); }
+#elif defined(MIP_GENERATOR_NEON)
+typedef float32x4_t Texel;
+
+inline Texel loadTexel(const float* values) { return vld1q_f32(values); }
+inline void storeTexel(float* values, Texel texel) { vst1q_f32(values, texel); }
+inline Texel zeroTexel() { return vdupq_n_f32(0.0f); }
+inline Texel multiplyAdd(Texel sum, Texel texel, float weight) { return vmlaq_n_f32(sum, texel, weight); }
+#else
+struct Texel {
+	float values[4];
+};
+
+inline Texel loadTexel(const float* values) { Texel texel; std::copy(values, values + 4, texel.values); return texel; }
+inline void storeTexel(float* values, Texel texel) { std::copy(texel.values, texel.values + 4, values); }
+inline Texel zeroTexel() { return Texel{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+inline Texel multiplyAdd(Texel sum, Texel texel, float weight) {
+	for (int c = 0; c < 4; c++) {
+		sum.values[c] += texel.values[c] * weight;
+	}
+	return sum;
+}
+#endif
+
+float srgbToLinear(float value) {
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+// Lookup tables between 8-bit channels and linear floats, built once
+struct ChannelTables {
+	float unormToFloat[256];
+	float srgbToLinear[256];
+
+	// srgbThresholds[i] is the linear value halfway between sRGB codes i and i + 1. Encoding starts
+	// from the code of the value's bucket and steps up past the thresholds it exceeds, which is an
+	// exact round to nearest in at most a couple of steps
+	float srgbThresholds[256];
+	unsigned char srgbBucketCodes[SRGB_BUCKETS + 1];
+
+	ChannelTables() {
+		for (int i = 0; i < 256; i++) {
+			unormToFloat[i] = i / 255.0f;
+			srgbToLinear[i] = ::srgbToLinear(i / 255.0f);
+		}
+		for (int i = 0; i < 255; i++) {
+			srgbThresholds[i] = 0.5f * (srgbToLinear[i] + srgbToLinear[i + 1]);
+		}
+		srgbThresholds[255] = 2.0f;
+
+		int code = 0;
+		for (int bucket = 0; bucket <= SRGB_BUCKETS; bucket++) {
+			float value = static_cast<float>(bucket) / SRGB_BUCKETS;
+			while (value >= srgbThresholds[code]) {
+				code++;
+			}
+			srgbBucketCodes[bucket] = static_cast<unsigned char>(code);
+		}
+	}
+
+	unsigned char linearToSrgb(float value) const {
+		int code = srgbBucketCodes[static_cast<int>(value * SRGB_BUCKETS)];
+		while (value >= srgbThresholds[code]) {
+			code++;
+		}
+		return static_cast<unsigned char>(code);
+	}
+};
+
+const ChannelTables& getChannelTables() {
+	static const ChannelTables tables;
+	return tables;
+}
+
+double besselI0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+// Weights of the source texels 2x-2 .. 2x+3 for destination texel x: a sinc windowed by a Kaiser
+// window (alpha 4) of three destination texels, normalized to keep flat areas unchanged
+struct KaiserKernel {
+	float weights[KAISER_TAPS];
+
+	KaiserKernel() {
+		const double pi = 3.14159265358979323846;
+		const double halfWidth = 1.5, alpha = 4.0;
+
+		double sum = 0.0;
+		double values[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++) {
+			// Distance from the destination texel center, in destination texels
+			double t = (k - (KAISER_TAPS - 1) * 0.5) * 0.5;
+			double sinc = std::sin(pi * t) / (pi * t);
+			double ratio = t / halfWidth;
+			double window = besselI0(alpha * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(alpha);
+			values[k] = sinc * window;
+			sum += values[k];
+		}
+
+		for (int k = 0; k < KAISER_TAPS; k++) {
+			weights[k] = static_cast<float>(values[k] / sum);
+		}
+	}
+};
+
+const KaiserKernel& getKaiserKernel() {
+	static const KaiserKernel kernel;
+	return kernel;
+}
+
+class LevelFilter {
+public:
+	LevelFilter(const unsigned char* source, const TextureLevel& sourceLevel, unsigned char* destination, const TextureLevel& destinationLevel,
+		const MipGenerationOptions& options)
+		: source(source), sourceLevel(sourceLevel), destination(destination), destinationLevel(destinationLevel), options(options),
+		tables(getChannelTables()), colorTable(options.srgb ? tables.srgbToLinear : tables.unormToFloat) {}
+
+	uint32_t getTileCount() const {
+		return getTilesWide() * ((destinationLevel.height + TILE_SIZE - 1) / TILE_SIZE);
+	}
+
+	void filterTile(uint32_t tile, std::vector<float>& scratch) const {
+		uint32_t x0 = tile % getTilesWide() * TILE_SIZE;
+		uint32_t y0 = tile / getTilesWide() * TILE_SIZE;
+		uint32_t x1 = std::min(x0 + TILE_SIZE, destinationLevel.width);
+		uint32_t y1 = std::min(y0 + TILE_SIZE, destinationLevel.height);
+
+		if (options.filter == MipFilter::Kaiser) {
+			filterKaiser(x0, y0, x1, y1, scratch);
+		}
+		else {
+			filterBox(x0, y0, x1, y1);
+		}
+	}
+
+private:
+	const unsigned char* source;
+	const TextureLevel& sourceLevel;
+	unsigned char* destination;
+	const TextureLevel& destinationLevel;
+	const MipGenerationOptions& options;
+	const ChannelTables& tables;
+	const float* colorTable;
+
+	uint32_t getTilesWide() const {
+		return (destinationLevel.width + TILE_SIZE - 1) / TILE_SIZE;
+	}
+
+	Texel decode(int32_t x, int32_t y) const {
+		x = std::min(std::max(x, 0), static_cast<int32_t>(sourceLevel.width) - 1);
+		y = std::min(std::max(y, 0), static_cast<int32_t>(sourceLevel.height) - 1);
+		const unsigned char* texel = source + (static_cast<size_t>(y) * sourceLevel.width + x) * BYTES_PER_TEXEL;
+
+		float values[4] = { colorTable[texel[0]], colorTable[texel[1]], colorTable[texel[2]], tables.unormToFloat[texel[3]] };
+		return loadTexel(values);
+	}
+
+	void encode(uint32_t x, uint32_t y, Texel texel) const {
+		float values[4];
+		storeTexel(values, texel);
+
+		unsigned char* output = destination + (static_cast<size_t>(y) * destinationLevel.width + x) * BYTES_PER_TEXEL;
+		for (int c = 0; c < 4; c++) {
+			float value = std::min(std::max(values[c], 0.0f), 1.0f);
+			if (options.srgb && c < 3) {
+				output[c] = tables.linearToSrgb(value);
+			}
+			else {
+				output[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	void filterBox(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const {
+		for (uint32_t y = y0; y < y1; y++) {
+			for (uint32_t x = x0; x < x1; x++) {
+				int32_t sourceX = static_cast<int32_t>(x * 2), sourceY = static_cast<int32_t>(y * 2);
+
+				Texel sum = zeroTexel();
+				sum = multiplyAdd(sum, decode(sourceX, sourceY), 0.25f);
+				sum = multiplyAdd(sum, decode(sourceX + 1, sourceY), 0.25f);
+				sum = multiplyAdd(sum, decode(sourceX, sourceY + 1), 0.25f);
+				sum = multiplyAdd(sum, decode(sourceX + 1, sourceY + 1), 0.25f);
+				encode(x, y, sum);
+			}
+		}
+	}
+
+	// Separable: filters the source rows under the tile horizontally into scratch, then filters
+	// scratch vertically
+	void filterKaiser(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, std::vector<float>& scratch) const {
+		const float* weights = getKaiserKernel().weights;
+		const int32_t reach = KAISER_TAPS / 2 - 1;
+
+		int32_t firstRow = static_cast<int32_t>(y0 * 2) - reach;
+		int32_t rowCount = static_cast<int32_t>((y1 - y0) * 2) + KAISER_TAPS - 2;
+		uint32_t tileWidth = x1 - x0;
+		scratch.resize(static_cast<size_t>(rowCount) * tileWidth * 4);
+
+		for (int32_t row = 0; row < rowCount; row++) {
+			for (uint32_t x = x0; x < x1; x++) {
+				Texel sum = zeroTexel();
+				for (int k = 0; k < KAISER_TAPS; k++) {
+					sum = multiplyAdd(sum, decode(static_cast<int32_t>(x * 2) - reach + k, firstRow + row), weights[k]);
+				}
+				storeTexel(&scratch[(static_cast<size_t>(row) * tileWidth + (x - x0)) * 4], sum);
+			}
+		}
+
+		for (uint32_t y = y0; y < y1; y++) {
+			int32_t row = static_cast<int32_t>(y * 2) - reach - firstRow;
+			for (uint32_t x = x0; x < x1; x++) {
+				Texel sum = zeroTexel();
+				for (int k = 0; k < KAISER_TAPS; k++) {
+					sum = multiplyAdd(sum, loadTexel(&scratch[(static_cast<size_t>(row + k) * tileWidth + (x - x0)) * 4]), weights[k]);
+				}
+				encode(x, y, sum);
+			}
+		}
+	}
+};
+
+} // namespace
+
+void generateMipChain(unsigned char* data, const std::vector<TextureLevel>& levels, const MipGenerationOptions& options) {
+	unsigned threadCount = resolveThreadCount(options.threadCount);
+
+	for (size_t i = 1; i < levels.size(); i++) {
+		LevelFilter filter(data + levels[i - 1].offset, levels[i - 1], data + levels[i].offset, levels[i], options);
+
+		// Workers pull tiles from a shared counter, so uneven tiles at the edges balance out
+		uint32_t tileCount = filter.getTileCount();
+		std::atomic<uint32_t> nextTile(0);
+
+		runParallel(std::min<size_t>(threadCount, tileCount), [&](size_t) {
+			std::vector<float> scratch;
+			for (uint32_t tile = nextTile++; tile < tileCount; tile = nextTile++) {
+				filter.filterTile(tile, scratch);
+			}
+		});
+	}
+}
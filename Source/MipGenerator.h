@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "TextureCache.h"
+
+enum class MipFilter {
+	// 2x2 average, the footprint of a linear vkCmdBlitImage
+	Box,
+	// 6-tap Kaiser windowed sinc, sharper than the box with less aliasing
+	Kaiser
+};
+
+struct MipGenerationOptions {
+	MipFilter filter = MipFilter::Box;
+
+	// RGB is sRGB encoded and is filtered in linear space. Alpha is always filtered as stored
+	bool srgb = false;
+
+	// Workers sharing the tiles of each level. 0 uses every hardware thread
+	unsigned threadCount = 1;
+};
+
+// Fills levels 1..n-1 of an RGBA8 mip chain laid out by layoutMipChain from level 0, each level
+// filtered from the previous one. Runs on the CPU, with SSE2 or NEON where available, so the
+// chain can be cooked into the texture cache and does not depend on linear blit support.
+void generateMipChain(unsigned char* data, const std::vector<TextureLevel>& levels, const MipGenerationOptions& options = MipGenerationOptions());
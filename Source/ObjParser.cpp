@@ -0,0 +1,564 @@
+#include "ObjParser.h"
+
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+// Chunks smaller than this are not worth a thread of their own
+const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+inline bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+inline void skipSpaces(const char*& p, const char* end) {
+	while (p < end && isSpace(*p)) {
+		p++;
+	}
+}
+
+// Parses [+-]digits[.digits][(e|E)[+-]digits]. Unlike strtod this ignores the C locale and never
+// allocates. Up to 19 significant digits are kept, which is far beyond float precision.
+bool parseFloat(const char*& p, const char* end, float& value) {
+	skipSpaces(p, end);
+
+	const char* s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		s++;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+
+	for (; s < end && isDigit(*s); s++) {
+		anyDigits = true;
+		if (significantDigits < 19) {
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+			if (mantissa != 0) {
+				significantDigits++;
+			}
+		}
+		else {
+			exponent++;
+		}
+	}
+
+	if (s < end && *s == '.') {
+		s++;
+		for (; s < end && isDigit(*s); s++) {
+			anyDigits = true;
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*s - '0');
+				if (mantissa != 0) {
+					significantDigits++;
+				}
+				exponent--;
+			}
+		}
+	}
+
+	if (!anyDigits) {
+		return false;
+	}
+
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char* e = s + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExponent = *e == '-';
+			e++;
+		}
+
+		if (e < end && isDigit(*e)) {
+			int explicitExponent = 0;
+			for (; e < end && isDigit(*e); e++) {
+				if (explicitExponent < 10000) {
+					explicitExponent = explicitExponent * 10 + (*e - '0');
+				}
+			}
+			exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			s = e;
+		}
+	}
+
+	double result = static_cast<double>(mantissa);
+	if (mantissa != 0) {
+		if (exponent >= 0 && exponent <= 22) {
+			result *= POWERS_OF_TEN[exponent];
+		}
+		else if (exponent < 0 && exponent >= -22) {
+			result /= POWERS_OF_TEN[-exponent];
+		}
+		else {
+			result *= std::pow(10.0, exponent);
+		}
+	}
+
+	value = static_cast<float>(negative ? -result : result);
+	p = s;
+	return true;
+}
+
+bool parseInt(const char*& p, const char* end, int& value) {
+	const char* s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		s++;
+	}
+
+	if (s == end || !isDigit(*s)) {
+		return false;
+	}
+
+	int64_t result = 0;
+	for (; s < end && isDigit(*s); s++) {
+		if (result <= INT32_MAX) {
+			result = result * 10 + (*s - '0');
+		}
+	}
+
+	if (result > INT32_MAX) {
+		return false;
+	}
+
+	value = static_cast<int>(negative ? -result : result);
+	p = s;
+	return true;
+}
+
+struct ShapeStart {
+	std::string name;
+	// Position in Chunk::indices where the shape begins
+	size_t indexOffset;
+};
+
+// Negative OBJ indices count back from the last element read so far. A chunk can only resolve them
+// against its own element counts, so the chunk's base offsets are added while merging.
+struct RelativeIndex {
+	size_t position;
+	bool vertex;
+	bool texcoord;
+	bool normal;
+};
+
+struct Chunk {
+	const char* begin;
+	const char* end;
+
+	std::vector<tinyobj::real_t> vertices;
+	std::vector<tinyobj::real_t> colors;
+	std::vector<tinyobj::real_t> texcoords;
+	std::vector<tinyobj::real_t> normals;
+	bool hasColors = false;
+
+	// Triangulated faces, three entries per triangle
+	std::vector<tinyobj::index_t> indices;
+	std::vector<RelativeIndex> relativeIndices;
+	std::vector<ShapeStart> shapeStarts;
+
+	std::string error;
+};
+
+class ChunkParser {
+public:
+	explicit ChunkParser(Chunk& chunk) : chunk(chunk) {
+	}
+
+	bool parse() {
+		const char* p = chunk.begin;
+		while (p < chunk.end) {
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(chunk.end - p)));
+			if (lineEnd == nullptr) {
+				lineEnd = chunk.end;
+			}
+
+			const char* contentEnd = lineEnd;
+			if (contentEnd > p && contentEnd[-1] == '\r') {
+				contentEnd--;
+			}
+
+			if (!parseLine(p, contentEnd)) {
+				chunk.error = "failed to parse OBJ line: " + std::string(p, contentEnd);
+				return false;
+			}
+
+			p = lineEnd + 1;
+		}
+
+		return true;
+	}
+
+private:
+	static bool keywordIs(const char* p, const char* end, const char* keyword, size_t length) {
+		return static_cast<size_t>(end - p) >= length && memcmp(p, keyword, length) == 0 &&
+			(p + length == end || isSpace(p[length]));
+	}
+
+	bool parseLine(const char* p, const char* end) {
+		skipSpaces(p, end);
+		if (p == end || *p == '#') {
+			return true;
+		}
+
+		if (keywordIs(p, end, "v", 1)) {
+			return parseVertex(p + 1, end);
+		}
+		if (keywordIs(p, end, "vt", 2)) {
+			return parseTexcoord(p + 2, end);
+		}
+		if (keywordIs(p, end, "vn", 2)) {
+			return parseNormal(p + 2, end);
+		}
+		if (keywordIs(p, end, "f", 1)) {
+			return parseFace(p + 1, end);
+		}
+		if (keywordIs(p, end, "o", 1) || keywordIs(p, end, "g", 1)) {
+			p++;
+			skipSpaces(p, end);
+			const char* nameEnd = end;
+			while (nameEnd > p && isSpace(nameEnd[-1])) {
+				nameEnd--;
+			}
+
+			ShapeStart start;
+			start.name.assign(p, nameEnd);
+			start.indexOffset = chunk.indices.size();
+			chunk.shapeStarts.push_back(start);
+			return true;
+		}
+
+		// usemtl, mtllib, s, l, p and unknown statements carry nothing the loader needs
+		return true;
+	}
+
+	bool parseVertex(const char* p, const char* end) {
+		float x, y, z;
+		if (!parseFloat(p, end, x) || !parseFloat(p, end, y) || !parseFloat(p, end, z)) {
+			return false;
+		}
+
+		// Either "x y z [w]" or the "x y z r g b" vertex color extension
+		float r, g, b;
+		const char* q = p;
+		if (parseFloat(q, end, r) && parseFloat(q, end, g) && parseFloat(q, end, b)) {
+			if (!chunk.hasColors) {
+				chunk.colors.resize(chunk.vertices.size(), 1.0f);
+				chunk.hasColors = true;
+			}
+			chunk.colors.push_back(r);
+			chunk.colors.push_back(g);
+			chunk.colors.push_back(b);
+		}
+		else if (chunk.hasColors) {
+			chunk.colors.push_back(1.0f);
+			chunk.colors.push_back(1.0f);
+			chunk.colors.push_back(1.0f);
+		}
+
+		chunk.vertices.push_back(x);
+		chunk.vertices.push_back(y);
+		chunk.vertices.push_back(z);
+		return true;
+	}
+
+	bool parseTexcoord(const char* p, const char* end) {
+		float u, v = 0.0f;
+		if (!parseFloat(p, end, u)) {
+			return false;
+		}
+		parseFloat(p, end, v);
+
+		chunk.texcoords.push_back(u);
+		chunk.texcoords.push_back(v);
+		return true;
+	}
+
+	bool parseNormal(const char* p, const char* end) {
+		float x, y, z;
+		if (!parseFloat(p, end, x) || !parseFloat(p, end, y) || !parseFloat(p, end, z)) {
+			return false;
+		}
+
+		chunk.normals.push_back(x);
+		chunk.normals.push_back(y);
+		chunk.normals.push_back(z);
+		return true;
+	}
+
+	// Converts a 1-based or negative OBJ index to 0-based. Negative indices are resolved against
+	// this chunk only and flagged for the merge
+	static int resolveIndex(int value, size_t localCount, bool& relative) {
+		relative = value < 0;
+		return relative ? static_cast<int>(localCount) + value : value - 1;
+	}
+
+	bool parseFace(const char* p, const char* end) {
+		faceVertices.clear();
+		faceRelative.clear();
+
+		while (true) {
+			skipSpaces(p, end);
+			if (p == end) {
+				break;
+			}
+
+			int v = 0, vt = 0, vn = 0;
+			if (!parseInt(p, end, v) || v == 0) {
+				return false;
+			}
+			if (p < end && *p == '/') {
+				p++;
+				if (p < end && *p != '/') {
+					if (!parseInt(p, end, vt) || vt == 0) {
+						return false;
+					}
+				}
+				if (p < end && *p == '/') {
+					p++;
+					if (!parseInt(p, end, vn) || vn == 0) {
+						return false;
+					}
+				}
+			}
+			if (p < end && !isSpace(*p)) {
+				return false;
+			}
+
+			RelativeIndex relative = {};
+			tinyobj::index_t index;
+			index.vertex_index = resolveIndex(v, chunk.vertices.size() / 3, relative.vertex);
+			index.texcoord_index = vt != 0 ? resolveIndex(vt, chunk.texcoords.size() / 2, relative.texcoord) : -1;
+			index.normal_index = vn != 0 ? resolveIndex(vn, chunk.normals.size() / 3, relative.normal) : -1;
+
+			faceVertices.push_back(index);
+			faceRelative.push_back(relative);
+		}
+
+		if (faceVertices.size() < 3) {
+			return false;
+		}
+
+		for (size_t i = 1; i + 1 < faceVertices.size(); i++) {
+			const size_t corners[] = { 0, i, i + 1 };
+			for (size_t corner : corners) {
+				const RelativeIndex& relative = faceRelative[corner];
+				if (relative.vertex || relative.texcoord || relative.normal) {
+					RelativeIndex fixup = relative;
+					fixup.position = chunk.indices.size();
+					chunk.relativeIndices.push_back(fixup);
+				}
+				chunk.indices.push_back(faceVertices[corner]);
+			}
+		}
+
+		return true;
+	}
+
+	Chunk& chunk;
+	std::vector<tinyobj::index_t> faceVertices;
+	std::vector<RelativeIndex> faceRelative;
+};
+
+struct ShapeSpan {
+	size_t shape;
+	size_t begin;
+	size_t end;
+	size_t destination;
+};
+
+} // namespace
+
+bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename, unsigned threadCount) {
+
+	attrib->vertices.clear();
+	attrib->colors.clear();
+	attrib->texcoords.clear();
+	attrib->normals.clear();
+	shapes->clear();
+
+	MappedFile file;
+	if (!file.open(filename)) {
+		if (err) {
+			*err = "failed to open OBJ file: " + std::string(filename);
+		}
+		return false;
+	}
+
+	threadCount = resolveThreadCount(threadCount);
+
+	const char* data = file.data();
+	size_t size = file.size();
+
+	size_t chunkCount = std::min<size_t>(threadCount, std::max<size_t>(1, size / MIN_CHUNK_SIZE));
+	std::vector<Chunk> chunks(chunkCount);
+
+	// Split evenly, then move every boundary past the next line break
+	const char* chunkBegin = data;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* chunkEnd = data + size;
+		if (i + 1 < chunkCount) {
+			chunkEnd = std::max(chunkBegin, data + size / chunkCount * (i + 1));
+			const char* lineBreak = static_cast<const char*>(memchr(chunkEnd, '\n', static_cast<size_t>(data + size - chunkEnd)));
+			chunkEnd = lineBreak != nullptr ? lineBreak + 1 : data + size;
+		}
+
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	runParallel(chunkCount, [&chunks](size_t i) {
+		try {
+			ChunkParser(chunks[i]).parse();
+		}
+		catch (const std::exception& e) {
+			chunks[i].error = e.what();
+		}
+	});
+
+	for (const auto& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			if (err) {
+				*err = chunk.error;
+			}
+			return false;
+		}
+	}
+
+	// Offsets of each chunk's elements in the merged arrays
+	std::vector<size_t> vertexBase(chunkCount), texcoordBase(chunkCount), normalBase(chunkCount);
+	size_t vertexCount = 0, texcoordCount = 0, normalCount = 0;
+	bool hasColors = false;
+	for (size_t i = 0; i < chunkCount; i++) {
+		vertexBase[i] = vertexCount;
+		texcoordBase[i] = texcoordCount;
+		normalBase[i] = normalCount;
+		vertexCount += chunks[i].vertices.size() / 3;
+		texcoordCount += chunks[i].texcoords.size() / 2;
+		normalCount += chunks[i].normals.size() / 3;
+		hasColors = hasColors || chunks[i].hasColors;
+	}
+
+	// Shapes continue across chunk boundaries until the next o/g statement. Like tinyobj, a
+	// statement that follows no faces only renames the shape
+	std::vector<std::vector<ShapeSpan>> chunkSpans(chunkCount);
+	std::vector<size_t> shapeSizes;
+	std::vector<std::string> shapeNames;
+	std::string currentName;
+	size_t currentSize = 0;
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		size_t cursor = 0;
+		auto addSpan = [&](size_t spanEnd) {
+			if (spanEnd > cursor) {
+				ShapeSpan span = { shapeNames.size(), cursor, spanEnd, currentSize };
+				chunkSpans[i].push_back(span);
+				currentSize += spanEnd - cursor;
+			}
+		};
+
+		for (const auto& start : chunks[i].shapeStarts) {
+			addSpan(start.indexOffset);
+			if (currentSize > 0) {
+				shapeNames.push_back(currentName);
+				shapeSizes.push_back(currentSize);
+				currentSize = 0;
+			}
+			currentName = start.name;
+			cursor = start.indexOffset;
+		}
+		addSpan(chunks[i].indices.size());
+	}
+	if (currentSize > 0) {
+		shapeNames.push_back(currentName);
+		shapeSizes.push_back(currentSize);
+	}
+
+	attrib->vertices.resize(vertexCount * 3);
+	attrib->texcoords.resize(texcoordCount * 2);
+	attrib->normals.resize(normalCount * 3);
+	if (hasColors) {
+		attrib->colors.resize(vertexCount * 3, 1.0f);
+	}
+
+	shapes->resize(shapeNames.size());
+	for (size_t s = 0; s < shapeNames.size(); s++) {
+		tinyobj::shape_t& shape = (*shapes)[s];
+		shape.name = shapeNames[s];
+		shape.mesh.indices.resize(shapeSizes[s]);
+		shape.mesh.num_face_vertices.assign(shapeSizes[s] / 3, 3);
+		shape.mesh.material_ids.assign(shapeSizes[s] / 3, -1);
+	}
+
+	runParallel(chunkCount, [&](size_t i) {
+		Chunk& chunk = chunks[i];
+
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + vertexBase[i] * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + texcoordBase[i] * 2);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + normalBase[i] * 3);
+		if (chunk.hasColors) {
+			chunk.colors.resize(chunk.vertices.size(), 1.0f);
+			std::copy(chunk.colors.begin(), chunk.colors.end(), attrib->colors.begin() + vertexBase[i] * 3);
+		}
+
+		for (const auto& relative : chunk.relativeIndices) {
+			tinyobj::index_t& index = chunk.indices[relative.position];
+			if (relative.vertex) index.vertex_index += static_cast<int>(vertexBase[i]);
+			if (relative.texcoord) index.texcoord_index += static_cast<int>(texcoordBase[i]);
+			if (relative.normal) index.normal_index += static_cast<int>(normalBase[i]);
+
+			if ((relative.vertex && index.vertex_index < 0) || (relative.texcoord && index.texcoord_index < 0) ||
+				(relative.normal && index.normal_index < 0)) {
+				chunk.error = "OBJ relative face index points before the start of the file";
+				return;
+			}
+		}
+
+		for (const auto& index : chunk.indices) {
+			if (index.vertex_index < 0 || static_cast<size_t>(index.vertex_index) >= vertexCount ||
+				index.texcoord_index < -1 || (index.texcoord_index >= 0 && static_cast<size_t>(index.texcoord_index) >= texcoordCount) ||
+				index.normal_index < -1 || (index.normal_index >= 0 && static_cast<size_t>(index.normal_index) >= normalCount)) {
+				chunk.error = "OBJ face index out of range";
+				return;
+			}
+		}
+
+		for (const auto& span : chunkSpans[i]) {
+			std::copy(chunk.indices.begin() + span.begin, chunk.indices.begin() + span.end,
+				(*shapes)[span.shape].mesh.indices.begin() + span.destination);
+		}
+	});
+
+	for (const auto& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			if (err) {
+				*err = chunk.error;
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <tiny_obj_loader.h>
+
+#include <string>
+#include <vector>
+
+// Drop-in replacement for tinyobj::LoadObj on large files. The file is memory mapped, split at
+// line boundaries into one chunk per thread and every chunk is parsed with a locale independent
+// number parser. The chunks are merged into the same attrib/shape form tinyobj produces, with
+// faces triangulated as a fan. Materials are not loaded: usemtl/mtllib are skipped and every face
+// gets material id -1. threadCount 0 uses every hardware thread.
+bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes, std::string* err,
+	const char* filename, unsigned threadCount = 0);
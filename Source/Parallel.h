@@ -0,0 +1,29 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Resolves a user supplied worker count, where 0 means one worker per hardware thread
+inline unsigned resolveThreadCount(unsigned threadCount) {
+	return threadCount != 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs task(i) for i in [0, count) with one thread per task, the calling thread taking task 0
+template<typename Task>
+void runParallel(size_t count, Task task) {
+	std::vector<std::thread> threads;
+	threads.reserve(count > 0 ? count - 1 : 0);
+	for (size_t i = 1; i < count; i++) {
+		threads.emplace_back(task, i);
+	}
+
+	if (count > 0) {
+		task(0);
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
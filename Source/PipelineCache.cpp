@@ -0,0 +1,138 @@
+#include "PipelineCache.h"
+
+#include "FileUtils.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+const char PIPELINE_CACHE_MAGIC[4] = { 'V', 'P', 'L', 'C' };
+
+struct PipelineCacheHeader {
+	char magic[4];
+	uint32_t version;
+
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+// The header vkGetPipelineCacheData places in front of the driver's data (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+struct VulkanPipelineCacheHeader {
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+bool headerMatches(const PipelineCacheHeader& header, const VkPhysicalDeviceProperties& properties) {
+	return memcmp(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC)) == 0 &&
+		header.version == PersistentPipelineCache::VERSION &&
+		header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+		header.driverVersion == properties.driverVersion &&
+		memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Drivers validate the blob themselves, but some are known to crash on data from another driver,
+// so the embedded header is checked as well
+bool blobMatches(const char* data, size_t size, const VkPhysicalDeviceProperties& properties) {
+	VulkanPipelineCacheHeader header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+		memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+} // namespace
+
+void PersistentPipelineCache::create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path) {
+	destroy();
+
+	this->device = device;
+	this->properties = properties;
+	this->path = path;
+
+	MappedFile file;
+	const char* initialData = nullptr;
+	size_t initialSize = 0;
+
+	if (file.open(path) && file.size() >= sizeof(PipelineCacheHeader)) {
+		PipelineCacheHeader header;
+		memcpy(&header, file.data(), sizeof(header));
+
+		const char* data = file.data() + sizeof(header);
+		if (headerMatches(header, properties) && header.dataSize == file.size() - sizeof(header) &&
+			hashBytes(data, static_cast<size_t>(header.dataSize)) == header.dataHash &&
+			blobMatches(data, static_cast<size_t>(header.dataSize), properties)) {
+			initialData = data;
+			initialSize = static_cast<size_t>(header.dataSize);
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = initialSize;
+	createInfo.pInitialData = initialData;
+
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	loadedSize = initialSize;
+}
+
+bool PersistentPipelineCache::save() const {
+	if (cache == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS) {
+		return false;
+	}
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+		return false;
+	}
+
+	// Zeroed including the padding in front of dataSize, so equal caches give identical files
+	PipelineCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(PIPELINE_CACHE_MAGIC));
+	header.version = VERSION;
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = size;
+	header.dataHash = hashBytes(data.data(), size);
+
+	std::vector<FileChunk> chunks = {
+		{ &header, sizeof(header) },
+		{ data.data(), size }
+	};
+
+	return writeFileAtomically(path, chunks);
+}
+
+void PersistentPipelineCache::destroy() {
+	if (cache != VK_NULL_HANDLE) {
+		vkDestroyPipelineCache(device, cache, nullptr);
+		cache = VK_NULL_HANDLE;
+	}
+	loadedSize = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+// VkPipelineCache that persists between runs:
+//
+//   PipelineCacheHeader | vkGetPipelineCacheData blob
+//
+// The header records the vendor, device, driver version and pipeline cache UUID of the device
+// that wrote the blob, plus its size and hash. A file written by another device or driver, or
+// one that is truncated or corrupt, is ignored and the cache starts out empty.
+class PersistentPipelineCache {
+public:
+	static const uint32_t VERSION = 1;
+
+	// Creates the cache, seeded from path when the file matches the device
+	void create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path);
+
+	// Writes the current cache contents back to path, replacing the file atomically
+	bool save() const;
+
+	void destroy();
+
+	VkPipelineCache get() const {
+		return cache;
+	}
+
+	// Size of the blob the cache was seeded with, 0 if it started out empty
+	size_t getLoadedSize() const {
+		return loadedSize;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties = {};
+	std::string path;
+
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	size_t loadedSize = 0;
+};
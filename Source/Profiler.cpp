@@ -0,0 +1,240 @@
+#include "Profiler.h"
+
+#include "FileUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct ZoneEvent {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// Ring of zones written by one thread and drained by collect(). The writer only moves written and
+// the reader only moves read, so neither side needs a lock
+struct ZoneBuffer {
+	static const size_t CAPACITY = 1 << 14;
+
+	ZoneEvent events[CAPACITY];
+	std::atomic<uint64_t> written{ 0 };
+	std::atomic<uint64_t> read{ 0 };
+	// Zones lost because the buffer was full, i.e. collect() ran too rarely
+	std::atomic<uint64_t> dropped{ 0 };
+
+	// Trace track: 0 for the GPU, then threads in order of their first zone
+	uint32_t track = 0;
+
+	void push(const char* name, uint64_t begin, uint64_t end) {
+		uint64_t position = written.load(std::memory_order_relaxed);
+		if (position - read.load(std::memory_order_acquire) >= CAPACITY) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		events[position % CAPACITY] = { name, begin, end };
+		written.store(position + 1, std::memory_order_release);
+	}
+};
+
+// Last STATISTICS_WINDOW durations of a zone
+struct ZoneWindow {
+	std::vector<uint64_t> durations;
+	size_t next = 0;
+
+	void add(uint64_t duration) {
+		if (durations.size() < Profiler::STATISTICS_WINDOW) {
+			durations.push_back(duration);
+		}
+		else {
+			durations[next] = duration;
+			next = (next + 1) % Profiler::STATISTICS_WINDOW;
+		}
+	}
+};
+
+struct TraceEvent {
+	ZoneEvent zone;
+	uint32_t track;
+};
+
+struct ProfilerState {
+	// Guards the buffer list. Buffers are never freed, so a thread's pointer to its own stays valid
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<ZoneBuffer>> buffers;
+
+	ZoneBuffer gpuBuffer;
+
+	// Only touched by collect() and the functions reading its results
+	bool capturing = false;
+	std::map<std::string, ZoneWindow> windows;
+	// Windows by name pointer, to skip building a string for every zone. Equal names at different
+	// addresses share the window
+	std::unordered_map<const char*, ZoneWindow*> windowsByPointer;
+	std::vector<TraceEvent> trace;
+	uint64_t droppedTotal = 0;
+	uint64_t origin = Profiler::now();
+};
+
+ProfilerState& getState() {
+	static ProfilerState state;
+	return state;
+}
+
+ZoneBuffer& getThreadBuffer() {
+	thread_local ZoneBuffer* buffer = nullptr;
+	if (buffer == nullptr) {
+		ProfilerState& state = getState();
+		std::lock_guard<std::mutex> lock(state.buffersMutex);
+		state.buffers.emplace_back(new ZoneBuffer());
+		buffer = state.buffers.back().get();
+		buffer->track = static_cast<uint32_t>(state.buffers.size());
+	}
+	return *buffer;
+}
+
+void drain(ProfilerState& state, ZoneBuffer& buffer) {
+	uint64_t position = buffer.read.load(std::memory_order_relaxed);
+	uint64_t end = buffer.written.load(std::memory_order_acquire);
+
+	for (; position < end; position++) {
+		const ZoneEvent& event = buffer.events[position % ZoneBuffer::CAPACITY];
+		ZoneWindow*& window = state.windowsByPointer[event.name];
+		if (window == nullptr) {
+			window = &state.windows[event.name];
+		}
+		window->add(event.end - event.begin);
+		if (state.capturing) {
+			state.trace.push_back({ event, buffer.track });
+		}
+	}
+
+	buffer.read.store(end, std::memory_order_release);
+	state.droppedTotal += buffer.dropped.exchange(0, std::memory_order_relaxed);
+}
+
+// Names are string literals from the code, only quotes and backslashes need escaping
+std::string escapeJson(const char* text) {
+	std::string escaped;
+	for (; *text != '\0'; text++) {
+		if (*text == '"' || *text == '\\') {
+			escaped += '\\';
+		}
+		escaped += *text;
+	}
+	return escaped;
+}
+
+} // namespace
+
+std::atomic<bool> Profiler::enabled{ false };
+
+void Profiler::setEnabled(bool enable) {
+	getState();
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::setCapturing(bool capture) {
+	getState().capturing = capture;
+}
+
+uint64_t Profiler::now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::recordCpuZone(const char* name, uint64_t begin, uint64_t end) {
+	getThreadBuffer().push(name, begin, end);
+}
+
+void Profiler::recordGpuZone(const char* name, uint64_t begin, uint64_t end) {
+	getState().gpuBuffer.push(name, begin, end);
+}
+
+void Profiler::collect() {
+	ProfilerState& state = getState();
+
+	std::vector<ZoneBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(state.buffersMutex);
+		for (const auto& buffer : state.buffers) {
+			buffers.push_back(buffer.get());
+		}
+	}
+
+	for (ZoneBuffer* buffer : buffers) {
+		drain(state, *buffer);
+	}
+	drain(state, state.gpuBuffer);
+}
+
+void Profiler::printStatistics(std::ostream& out) {
+	ProfilerState& state = getState();
+
+	std::ios::fmtflags flags = out.flags();
+	out << "profile: last " << STATISTICS_WINDOW << " samples per zone" << std::endl;
+	out << std::setw(24) << "zone" << std::setw(10) << "samples" << std::setw(12) << "min ms" << std::setw(12) << "avg ms" << std::setw(12) << "p99 ms" << std::endl;
+
+	std::vector<uint64_t> sorted;
+	for (const auto& entry : state.windows) {
+		sorted = entry.second.durations;
+		std::sort(sorted.begin(), sorted.end());
+
+		uint64_t sum = 0;
+		for (uint64_t duration : sorted) {
+			sum += duration;
+		}
+
+		size_t p99 = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+		out << std::fixed << std::setprecision(3)
+			<< std::setw(24) << entry.first
+			<< std::setw(10) << sorted.size()
+			<< std::setw(12) << sorted.front() / 1e6
+			<< std::setw(12) << sum / 1e6 / sorted.size()
+			<< std::setw(12) << sorted[p99] / 1e6
+			<< std::endl;
+	}
+
+	if (state.droppedTotal > 0) {
+		out << "profile: " << state.droppedTotal << " zones dropped by full thread buffers" << std::endl;
+	}
+	out.flags(flags);
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+	ProfilerState& state = getState();
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+	json << "{\"traceEvents\":[\n";
+	json << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+
+	uint32_t trackCount;
+	{
+		std::lock_guard<std::mutex> lock(state.buffersMutex);
+		trackCount = static_cast<uint32_t>(state.buffers.size());
+	}
+	for (uint32_t track = 1; track <= trackCount; track++) {
+		json << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"CPU thread " << track << "\"}}";
+	}
+
+	// Complete events with microsecond times since the profiler started
+	for (const TraceEvent& event : state.trace) {
+		json << ",\n{\"name\":\"" << escapeJson(event.zone.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+			<< ",\"ts\":" << (static_cast<int64_t>(event.zone.begin - state.origin) / 1e3)
+			<< ",\"dur\":" << ((event.zone.end - event.zone.begin) / 1e3) << "}";
+	}
+
+	json << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	std::string text = json.str();
+	return writeFileAtomically(path, { { text.data(), text.size() } });
+}
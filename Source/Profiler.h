@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Frame profiler. Threads record CPU zones into buffers of their own without taking locks, the
+// renderer adds GPU zones already converted to the CPU clock, and collect() drains everything once
+// per frame into rolling per-zone statistics and, while capturing, into a trace that can be saved
+// in the Chrome trace event format (chrome://tracing, Perfetto).
+//
+// Nothing is recorded until setEnabled(true). A disabled zone costs one relaxed atomic load, so
+// the zones stay compiled in; defining PROFILER_DISABLED compiles them out entirely.
+class Profiler {
+public:
+	// Samples per zone the statistics are computed over
+	static const size_t STATISTICS_WINDOW = 256;
+
+	static bool isEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	static void setEnabled(bool enable);
+
+	// Keep every collected zone for writeChromeTrace instead of only the statistics
+	static void setCapturing(bool capture);
+
+	// Nanoseconds on std::chrono::steady_clock, the clock of every zone
+	static uint64_t now();
+
+	// Records a zone of the calling thread. name must outlive the profiler (a string literal)
+	static void recordCpuZone(const char* name, uint64_t begin, uint64_t end);
+
+	// Records a GPU zone in CPU clock nanoseconds. Must only be called from one thread at a time
+	static void recordGpuZone(const char* name, uint64_t begin, uint64_t end);
+
+	// Drains the zones recorded since the last call. Call from one thread, e.g. once per frame
+	static void collect();
+
+	// Minimum, average and 99th percentile of each zone's last STATISTICS_WINDOW durations
+	static void printStatistics(std::ostream& out);
+
+	static bool writeChromeTrace(const std::string& path);
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+// Times the enclosing scope as a CPU zone while the profiler is enabled
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : name(name), begin(Profiler::isEnabled() ? Profiler::now() : 0) {
+	}
+
+	~ProfileZone() {
+		if (begin != 0) {
+			Profiler::recordCpuZone(name, begin, Profiler::now());
+		}
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t begin;
+};
+
+#define PROFILE_ZONE_CONCATENATE_(a, b) a##b
+#define PROFILE_ZONE_CONCATENATE(a, b) PROFILE_ZONE_CONCATENATE_(a, b)
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_ZONE_CONCATENATE(profileZone, __LINE__)(name)
+#endif
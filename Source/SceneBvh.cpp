@@ -0,0 +1,313 @@
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_BVH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum class Containment {
+	Outside,
+	Intersecting,
+	Inside
+};
+
+// The six planes in structure of arrays form, padded to eight with planes every box is inside of.
+// The absolute normals turn a box's half extent into its projected radius
+struct alignas(16) PlaneSet {
+	float nx[8], ny[8], nz[8], d[8];
+	float ax[8], ay[8], az[8];
+};
+
+PlaneSet preparePlanes(const Frustum& frustum) {
+	PlaneSet set = {};
+	for (int i = 0; i < 8; i++) {
+		if (i < 6) {
+			set.nx[i] = frustum.planes[i][0];
+			set.ny[i] = frustum.planes[i][1];
+			set.nz[i] = frustum.planes[i][2];
+			set.d[i] = frustum.planes[i][3];
+		}
+		else {
+			set.d[i] = 1.0f;
+		}
+
+		set.ax[i] = std::abs(set.nx[i]);
+		set.ay[i] = std::abs(set.ny[i]);
+		set.az[i] = std::abs(set.nz[i]);
+	}
+	return set;
+}
+
+template<typename Box>
+Containment classify(const PlaneSet& planes, const Box& box) {
+#ifdef SCENE_BVH_SSE2
+	__m128 cx = _mm_set1_ps(box.center[0]);
+	__m128 cy = _mm_set1_ps(box.center[1]);
+	__m128 cz = _mm_set1_ps(box.center[2]);
+	__m128 ex = _mm_set1_ps(box.extent[0]);
+	__m128 ey = _mm_set1_ps(box.extent[1]);
+	__m128 ez = _mm_set1_ps(box.extent[2]);
+
+	int outside = 0;
+	int intersecting = 0;
+	for (int group = 0; group < 8; group += 4) {
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.nx + group), cx), _mm_mul_ps(_mm_load_ps(planes.ny + group), cy)),
+			_mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.nz + group), cz), _mm_load_ps(planes.d + group)));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(planes.ax + group), ex), _mm_mul_ps(_mm_load_ps(planes.ay + group), ey)),
+			_mm_mul_ps(_mm_load_ps(planes.az + group), ez));
+
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		intersecting |= _mm_movemask_ps(_mm_cmplt_ps(distance, radius));
+	}
+#else
+	bool outside = false;
+	bool intersecting = false;
+	for (int i = 0; i < 6; i++) {
+		float distance = planes.nx[i] * box.center[0] + planes.ny[i] * box.center[1] + planes.nz[i] * box.center[2] + planes.d[i];
+		float radius = planes.ax[i] * box.extent[0] + planes.ay[i] * box.extent[1] + planes.az[i] * box.extent[2];
+		outside = outside || distance + radius < 0.0f;
+		intersecting = intersecting || distance < radius;
+	}
+#endif
+
+	if (outside) {
+		return Containment::Outside;
+	}
+	return intersecting ? Containment::Intersecting : Containment::Inside;
+}
+
+struct CenterExtent {
+	float center[3];
+	float extent[3];
+};
+
+CenterExtent toCenterExtent(const Aabb& box) {
+	CenterExtent result;
+	for (int axis = 0; axis < 3; axis++) {
+		result.center[axis] = 0.5f * (box.min[axis] + box.max[axis]);
+		result.extent[axis] = 0.5f * (box.max[axis] - box.min[axis]);
+	}
+	return result;
+}
+
+Aabb emptyAabb() {
+	Aabb box;
+	for (int axis = 0; axis < 3; axis++) {
+		box.min[axis] = std::numeric_limits<float>::max();
+		box.max[axis] = -std::numeric_limits<float>::max();
+	}
+	return box;
+}
+
+void growAabb(Aabb& box, const Aabb& other) {
+	for (int axis = 0; axis < 3; axis++) {
+		box.min[axis] = std::min(box.min[axis], other.min[axis]);
+		box.max[axis] = std::max(box.max[axis], other.max[axis]);
+	}
+}
+
+} // namespace
+
+Frustum extractFrustum(const float viewProjection[16]) {
+	// Row r of the column-major matrix is elements r, r + 4, r + 8 and r + 12
+	auto row = [&](int r, int i) {
+		return viewProjection[r + 4 * i];
+	};
+
+	Frustum frustum;
+	for (int i = 0; i < 4; i++) {
+		frustum.planes[0][i] = row(3, i) + row(0, i);
+		frustum.planes[1][i] = row(3, i) - row(0, i);
+		frustum.planes[2][i] = row(3, i) + row(1, i);
+		frustum.planes[3][i] = row(3, i) - row(1, i);
+		frustum.planes[4][i] = row(2, i);
+		frustum.planes[5][i] = row(3, i) - row(2, i);
+	}
+
+	for (auto& plane : frustum.planes) {
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (int i = 0; i < 4; i++) {
+			plane[i] /= length;
+		}
+	}
+
+	return frustum;
+}
+
+Aabb transformAabb(const Aabb& box, const float transform[16]) {
+	CenterExtent local = toCenterExtent(box);
+
+	Aabb result;
+	for (int row = 0; row < 3; row++) {
+		float center = transform[12 + row];
+		float extent = 0.0f;
+		for (int column = 0; column < 3; column++) {
+			center += transform[4 * column + row] * local.center[column];
+			extent += std::abs(transform[4 * column + row]) * local.extent[column];
+		}
+		result.min[row] = center - extent;
+		result.max[row] = center + extent;
+	}
+	return result;
+}
+
+bool isAabbVisible(const Frustum& frustum, const Aabb& box) {
+	return classify(preparePlanes(frustum), toCenterExtent(box)) != Containment::Outside;
+}
+
+void cullBruteForce(const Frustum& frustum, const std::vector<Aabb>& boxes, std::vector<uint32_t>& visible, CullStats& stats) {
+	PlaneSet planes = preparePlanes(frustum);
+
+	size_t firstVisible = visible.size();
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if (classify(planes, toCenterExtent(boxes[i])) != Containment::Outside) {
+			visible.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	stats.boxesTested += static_cast<uint32_t>(boxes.size());
+	stats.visibleCount += static_cast<uint32_t>(visible.size() - firstVisible);
+	stats.culledCount += static_cast<uint32_t>(boxes.size() - (visible.size() - firstVisible));
+}
+
+void SceneBvh::build(const std::vector<Aabb>& objectBounds) {
+	nodes.clear();
+	objectIndices.resize(objectBounds.size());
+	for (size_t i = 0; i < objectIndices.size(); i++) {
+		objectIndices[i] = static_cast<uint32_t>(i);
+	}
+
+	if (objectBounds.empty()) {
+		objectBoxes.clear();
+		return;
+	}
+
+	std::vector<CenterExtent> centers(objectBounds.size());
+	for (size_t i = 0; i < objectBounds.size(); i++) {
+		centers[i] = toCenterExtent(objectBounds[i]);
+	}
+
+	nodes.reserve(2 * objectBounds.size() / MAX_LEAF_SIZE + 1);
+	nodes.push_back({ {}, 0, static_cast<uint32_t>(objectBounds.size()), 0 });
+
+	// Nodes are split in creation order, so children always end up after their parent
+	for (size_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++) {
+		uint32_t first = nodes[nodeIndex].firstObject;
+		uint32_t count = nodes[nodeIndex].objectCount;
+		if (count <= MAX_LEAF_SIZE) {
+			continue;
+		}
+
+		float centroidMin[3], centroidMax[3];
+		for (int axis = 0; axis < 3; axis++) {
+			centroidMin[axis] = std::numeric_limits<float>::max();
+			centroidMax[axis] = -std::numeric_limits<float>::max();
+		}
+		for (uint32_t i = first; i < first + count; i++) {
+			const CenterExtent& object = centers[objectIndices[i]];
+			for (int axis = 0; axis < 3; axis++) {
+				centroidMin[axis] = std::min(centroidMin[axis], object.center[axis]);
+				centroidMax[axis] = std::max(centroidMax[axis], object.center[axis]);
+			}
+		}
+
+		int splitAxis = 0;
+		for (int axis = 1; axis < 3; axis++) {
+			if (centroidMax[axis] - centroidMin[axis] > centroidMax[splitAxis] - centroidMin[splitAxis]) {
+				splitAxis = axis;
+			}
+		}
+
+		uint32_t half = count / 2;
+		std::nth_element(objectIndices.begin() + first, objectIndices.begin() + first + half, objectIndices.begin() + first + count,
+			[&](uint32_t a, uint32_t b) { return centers[a].center[splitAxis] < centers[b].center[splitAxis]; });
+
+		uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+		nodes[nodeIndex].firstChild = firstChild;
+		nodes.push_back({ {}, first, half, 0 });
+		nodes.push_back({ {}, first + half, count - half, 0 });
+	}
+
+	refit(objectBounds);
+}
+
+void SceneBvh::refit(const std::vector<Aabb>& objectBounds) {
+	objectBoxes.resize(objectIndices.size());
+	for (size_t i = 0; i < objectIndices.size(); i++) {
+		CenterExtent box = toCenterExtent(objectBounds[objectIndices[i]]);
+		objectBoxes[i] = { { box.center[0], box.center[1], box.center[2] }, { box.extent[0], box.extent[1], box.extent[2] } };
+	}
+
+	// Children come after their parent, so walking backwards visits them first
+	for (size_t nodeIndex = nodes.size(); nodeIndex-- > 0;) {
+		Node& node = nodes[nodeIndex];
+
+		Aabb bounds = emptyAabb();
+		if (node.firstChild == 0) {
+			for (uint32_t i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+				growAabb(bounds, objectBounds[objectIndices[i]]);
+			}
+		}
+		else {
+			for (uint32_t child = node.firstChild; child < node.firstChild + 2; child++) {
+				const Box& childBounds = nodes[child].bounds;
+				for (int axis = 0; axis < 3; axis++) {
+					bounds.min[axis] = std::min(bounds.min[axis], childBounds.center[axis] - childBounds.extent[axis]);
+					bounds.max[axis] = std::max(bounds.max[axis], childBounds.center[axis] + childBounds.extent[axis]);
+				}
+			}
+		}
+
+		CenterExtent box = toCenterExtent(bounds);
+		node.bounds = { { box.center[0], box.center[1], box.center[2] }, { box.extent[0], box.extent[1], box.extent[2] } };
+	}
+}
+
+void SceneBvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const {
+	size_t firstVisible = visible.size();
+	PlaneSet planes = preparePlanes(frustum);
+
+	// A balanced tree over 2^32 objects is 32 levels deep, and every level keeps at most one
+	// sibling on the stack
+	uint32_t stack[64];
+	uint32_t stackSize = 0;
+	if (!nodes.empty()) {
+		stack[stackSize++] = 0;
+	}
+
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		stats.boxesTested++;
+
+		Containment containment = classify(planes, node.bounds);
+		if (containment == Containment::Outside) {
+			continue;
+		}
+
+		if (containment == Containment::Inside) {
+			visible.insert(visible.end(), objectIndices.begin() + node.firstObject, objectIndices.begin() + node.firstObject + node.objectCount);
+		}
+		else if (node.firstChild == 0) {
+			for (uint32_t i = node.firstObject; i < node.firstObject + node.objectCount; i++) {
+				if (classify(planes, objectBoxes[i]) != Containment::Outside) {
+					visible.push_back(objectIndices[i]);
+				}
+			}
+			stats.boxesTested += node.objectCount;
+		}
+		else {
+			stack[stackSize++] = node.firstChild + 1;
+			stack[stackSize++] = node.firstChild;
+		}
+	}
+
+	uint32_t visibleCount = static_cast<uint32_t>(visible.size() - firstVisible);
+	stats.visibleCount += visibleCount;
+	stats.culledCount += static_cast<uint32_t>(objectIndices.size()) - visibleCount;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Aabb {
+	float min[3];
+	float max[3];
+};
+
+// Planes of a view frustum, each a normal pointing inwards (xyz) and a distance (w)
+struct Frustum {
+	float planes[6][4];
+};
+
+// Frustum of a column-major view projection with [0, 1] clip space depth, with normalized planes
+Frustum extractFrustum(const float viewProjection[16]);
+
+// Bounds of box after a column-major affine transform
+Aabb transformAabb(const Aabb& box, const float transform[16]);
+
+// Counters of one cull
+struct CullStats {
+	uint32_t visibleCount = 0;
+	uint32_t culledCount = 0;
+	// Bounding boxes tested against the frustum, nodes and objects alike
+	uint32_t boxesTested = 0;
+};
+
+// Whether box lies at least partly inside the frustum. Conservative: a box beside a corner of the
+// frustum may pass even though it is outside
+bool isAabbVisible(const Frustum& frustum, const Aabb& box);
+
+// Tests every box on its own, appending the indices of the visible ones to visible in order
+void cullBruteForce(const Frustum& frustum, const std::vector<Aabb>& boxes, std::vector<uint32_t>& visible, CullStats& stats);
+
+// Binary bounding volume hierarchy over the bounds of the scene objects, built by splitting at the
+// median centroid along the widest axis. Every node covers a contiguous range of objects, so a
+// node that lies entirely inside the frustum accepts its whole range without visiting its subtree.
+// The boxes are tested against all six planes at once with SSE2 where available.
+class SceneBvh {
+public:
+	static const uint32_t MAX_LEAF_SIZE = 4;
+
+	void build(const std::vector<Aabb>& objectBounds);
+
+	// Recomputes every node's bounds from the moved objects, keeping the tree. Linear time, but the
+	// tree loses efficiency as objects drift away from where it was built
+	void refit(const std::vector<Aabb>& objectBounds);
+
+	// Appends the indices of the objects whose bounds are visible to visible, in tree order
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const;
+
+	size_t getObjectCount() const {
+		return objectIndices.size();
+	}
+
+	size_t getNodeCount() const {
+		return nodes.size();
+	}
+
+private:
+	// Boxes are kept as center and half extent, the form the frustum test uses
+	struct Box {
+		float center[3];
+		float extent[3];
+	};
+
+	struct Node {
+		Box bounds;
+		// Range of objectIndices under the node
+		uint32_t firstObject;
+		uint32_t objectCount;
+		// The children are nodes[firstChild] and nodes[firstChild + 1], which always come after
+		// their parent. 0 for leaves
+		uint32_t firstChild;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> objectIndices;
+	// Object bounds in objectIndices order
+	std::vector<Box> objectBoxes;
+};
@@ -0,0 +1,232 @@
+#include "StartupGraph.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+StartupGraph::PhaseId StartupGraph::addOrderedPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work) {
+	return addPhase(name, dependencies, std::move(work), true);
+}
+
+StartupGraph::PhaseId StartupGraph::addParallelPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work) {
+	return addPhase(name, dependencies, std::move(work), false);
+}
+
+StartupGraph::PhaseId StartupGraph::addPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work, bool ordered) {
+	for (PhaseId dependency : dependencies) {
+		if (dependency >= phases.size()) {
+			throw std::runtime_error(std::string("startup phase ") + name + " depends on a phase added after it!");
+		}
+	}
+
+	Phase phase;
+	phase.name = name;
+	phase.dependencies = dependencies;
+	phase.work = std::move(work);
+	phase.ordered = ordered;
+	phases.push_back(std::move(phase));
+	return phases.size() - 1;
+}
+
+void StartupGraph::run(ThreadPool& pool) {
+	std::mutex mutex;
+	std::condition_variable changed;
+	bool failed = false;
+
+	size_t parallelCount = 0;
+	for (const Phase& phase : phases) {
+		parallelCount += phase.ordered ? 0 : 1;
+	}
+	size_t parallelUnstarted = parallelCount;
+	size_t parallelUnfinished = parallelCount;
+
+	auto isReady = [&](const Phase& phase) {
+		for (PhaseId dependency : phase.dependencies) {
+			if (!phases[dependency].finished) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	auto findReadyParallel = [&]() -> Phase* {
+		for (Phase& phase : phases) {
+			if (!phase.ordered && !phase.started && isReady(phase)) {
+				return &phase;
+			}
+		}
+		return nullptr;
+	};
+
+	// Unstarted parallel phase among the dependencies of id (direct or not) that could run right now
+	std::function<Phase*(PhaseId)> findReadyDependency = [&](PhaseId id) -> Phase* {
+		for (PhaseId dependency : phases[id].dependencies) {
+			Phase& phase = phases[dependency];
+			if (phase.finished || phase.started) {
+				continue;
+			}
+			if (!phase.ordered && isReady(phase)) {
+				return &phase;
+			}
+			if (Phase* found = findReadyDependency(dependency)) {
+				return found;
+			}
+		}
+		return nullptr;
+	};
+
+	// Runs a claimed phase with the lock released. Timestamps are only touched by the running thread
+	auto execute = [&](std::unique_lock<std::mutex>& lock, Phase& phase, size_t thread) {
+		phase.started = true;
+		phase.thread = thread;
+		if (!phase.ordered) {
+			parallelUnstarted--;
+		}
+		lock.unlock();
+
+		phase.begin = Profiler::now();
+		try {
+			phase.work();
+		}
+		catch (...) {
+			lock.lock();
+			failed = true;
+			changed.notify_all();
+			throw;
+		}
+		phase.end = Profiler::now();
+
+		if (Profiler::isEnabled()) {
+			Profiler::recordCpuZone(phase.name, phase.begin, phase.end);
+		}
+
+		lock.lock();
+		phase.finished = true;
+		if (!phase.ordered) {
+			parallelUnfinished--;
+		}
+		changed.notify_all();
+	};
+
+	startTime = Profiler::now();
+
+	size_t threadCount = std::min<size_t>(pool.getThreadCount(), parallelCount + 1);
+	pool.run(threadCount, [&](size_t thread) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (thread != 0) {
+			while (!failed && parallelUnstarted > 0) {
+				if (Phase* phase = findReadyParallel()) {
+					execute(lock, *phase, thread);
+				}
+				else {
+					changed.wait(lock);
+				}
+			}
+			return;
+		}
+
+		// The calling thread owns the ordered phases. While one waits it only helps with the parallel
+		// phases it waits for, so a slow unrelated load cannot hold up device creation
+		for (PhaseId id = 0; id < phases.size(); id++) {
+			Phase& phase = phases[id];
+			if (!phase.ordered) {
+				continue;
+			}
+
+			while (!failed && !isReady(phase)) {
+				if (Phase* dependency = findReadyDependency(id)) {
+					execute(lock, *dependency, thread);
+				}
+				else {
+					changed.wait(lock);
+				}
+			}
+			if (failed) {
+				return;
+			}
+
+			execute(lock, phase, thread);
+		}
+
+		// Parallel phases no ordered phase depends on
+		while (!failed && parallelUnfinished > 0) {
+			if (Phase* phase = findReadyParallel()) {
+				execute(lock, *phase, thread);
+			}
+			else {
+				changed.wait(lock);
+			}
+		}
+	});
+}
+
+double StartupGraph::getMilliseconds() const {
+	uint64_t end = startTime;
+	for (const Phase& phase : phases) {
+		end = std::max(end, phase.end);
+	}
+	return (end - startTime) / 1e6;
+}
+
+void StartupGraph::printTimings(std::ostream& out) const {
+	if (phases.empty()) {
+		return;
+	}
+
+	// Walk back from the last phase to finish through whichever predecessor finished last: a
+	// dependency, or for ordered phases the ordered phase before it
+	std::vector<bool> critical(phases.size(), false);
+	PhaseId last = 0;
+	for (PhaseId id = 1; id < phases.size(); id++) {
+		if (phases[id].end > phases[last].end) {
+			last = id;
+		}
+	}
+
+	for (PhaseId id = last;;) {
+		critical[id] = true;
+
+		std::vector<PhaseId> predecessors = phases[id].dependencies;
+		if (phases[id].ordered) {
+			for (PhaseId previous = id; previous-- > 0;) {
+				if (phases[previous].ordered) {
+					predecessors.push_back(previous);
+					break;
+				}
+			}
+		}
+
+		if (predecessors.empty()) {
+			break;
+		}
+		id = *std::max_element(predecessors.begin(), predecessors.end(), [&](PhaseId a, PhaseId b) {
+			return phases[a].end < phases[b].end;
+		});
+	}
+
+	std::ios::fmtflags flags = out.flags();
+	out << std::setw(28) << "phase" << std::setw(10) << "thread" << std::setw(12) << "start ms" << std::setw(12) << "ms" << std::endl;
+
+	uint64_t workTotal = 0;
+	for (PhaseId id = 0; id < phases.size(); id++) {
+		const Phase& phase = phases[id];
+		workTotal += phase.end - phase.begin;
+
+		out << std::fixed << std::setprecision(3)
+			<< std::setw(28) << phase.name
+			<< std::setw(10) << phase.thread
+			<< std::setw(12) << (phase.begin - startTime) / 1e6
+			<< std::setw(12) << (phase.end - phase.begin) / 1e6
+			<< (critical[id] ? "  critical" : "")
+			<< std::endl;
+	}
+
+	out << "startup: " << phases.size() << " phases did " << workTotal / 1e6 << " ms of work in " << getMilliseconds() << " ms" << std::endl;
+	out.flags(flags);
+}
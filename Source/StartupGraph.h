@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <ostream>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Startup work split into named phases with declared dependencies. Ordered phases (everything that
+// creates Vulkan objects) run one after the other on the calling thread in the order they were
+// added, so their relative order never changes. Parallel phases (CPU work such as asset loading)
+// start on a pool thread as soon as their dependencies finished, and the calling thread picks one
+// up itself when the next ordered phase waits for it. Dependencies must be added before their
+// dependents, which rules out cycles.
+class StartupGraph {
+public:
+	typedef size_t PhaseId;
+
+	// name must outlive the graph (a string literal)
+	PhaseId addOrderedPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work);
+	PhaseId addParallelPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work);
+
+	// Runs every phase, on up to pool.getThreadCount() threads. The first exception thrown by a phase
+	// stops phases from starting and is rethrown once the running ones finished
+	void run(ThreadPool& pool);
+
+	// Milliseconds from the start of run() to the end of the last phase
+	double getMilliseconds() const;
+
+	// Start, duration and thread of every phase, plus the critical path through the dependencies
+	void printTimings(std::ostream& out) const;
+
+private:
+	struct Phase {
+		const char* name;
+		std::vector<PhaseId> dependencies;
+		std::function<void()> work;
+		bool ordered;
+
+		// Written while running
+		bool started = false;
+		bool finished = false;
+		uint64_t begin = 0;
+		uint64_t end = 0;
+		// 0 for the calling thread
+		size_t thread = 0;
+	};
+
+	std::vector<Phase> phases;
+	uint64_t startTime = 0;
+
+	PhaseId addPhase(const char* name, std::initializer_list<PhaseId> dependencies, std::function<void()> work, bool ordered);
+};
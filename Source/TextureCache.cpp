@@ -0,0 +1,205 @@
+#include "TextureCache.h"
+
+#include "FileUtils.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+const char TEXTURE_CACHE_MAGIC[4] = { 'V', 'T', 'E', 'X' };
+const uint32_t MAX_CACHED_LEVELS = 32;
+
+// Levels and the data blob start at this alignment, which satisfies the bufferOffset rules of
+// vkCmdCopyBufferToImage for every format the cache stores
+const uint64_t LEVEL_ALIGNMENT = 16;
+
+struct TextureCacheHeader {
+	char magic[4];
+	uint32_t version;
+
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+	uint64_t sourceHash;
+
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+
+	uint64_t dataOffset;
+	uint64_t dataSize;
+};
+
+struct TextureCacheLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+uint32_t getMipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levelCount = 1;
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+		levelCount++;
+	}
+	return levelCount;
+}
+
+bool getTextureFormatInfo(VkFormat format, TextureFormatInfo& info) {
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		info = { 1, 1, 4 };
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		info = { 4, 4, 8 };
+		return true;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+		info = { 4, 4, 16 };
+		return true;
+	default:
+		return false;
+	}
+}
+
+uint64_t layoutMipChain(uint32_t width, uint32_t height, VkFormat format, std::vector<TextureLevel>& levels) {
+	TextureFormatInfo info;
+	if (!getTextureFormatInfo(format, info)) {
+		levels.clear();
+		return 0;
+	}
+
+	levels.resize(getMipLevelCount(width, height));
+
+	uint64_t offset = 0;
+	for (size_t i = 0; i < levels.size(); i++) {
+		TextureLevel& level = levels[i];
+		level.width = std::max(width >> i, 1u);
+		level.height = std::max(height >> i, 1u);
+		level.offset = offset;
+		uint64_t blocksWide = (level.width + info.blockWidth - 1) / info.blockWidth;
+		uint64_t blocksHigh = (level.height + info.blockHeight - 1) / info.blockHeight;
+		level.size = blocksWide * blocksHigh * info.bytesPerBlock;
+		offset = alignUp(offset + level.size, LEVEL_ALIGNMENT);
+	}
+
+	return offset;
+}
+
+bool TextureCache::open(const std::string& cachePath, const std::string& sourcePath, VkFormat format) {
+	close();
+
+	if (!file.open(cachePath) || file.size() < sizeof(TextureCacheHeader)) {
+		close();
+		return false;
+	}
+
+	TextureCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	uint64_t levelIndexEnd = sizeof(TextureCacheHeader) + static_cast<uint64_t>(header.levelCount) * sizeof(TextureCacheLevel);
+
+	bool valid = memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC)) == 0 && header.version == VERSION &&
+		header.format == static_cast<uint32_t>(format) &&
+		header.levelCount > 0 && header.levelCount <= MAX_CACHED_LEVELS &&
+		header.dataOffset % LEVEL_ALIGNMENT == 0 && header.dataOffset >= levelIndexEnd &&
+		header.dataOffset <= file.size() && header.dataSize <= file.size() - header.dataOffset;
+
+	valid = valid && isCacheSourceCurrent(cachePath, offsetof(TextureCacheHeader, sourceModifiedTime), sourcePath,
+		header.sourceSize, header.sourceModifiedTime, header.sourceHash);
+
+	if (!valid) {
+		close();
+		return false;
+	}
+
+	// Every level must have exactly the dimensions and size this format implies
+	layoutMipChain(header.width, header.height, format, view.levels);
+	if (view.levels.size() != header.levelCount) {
+		close();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		TextureCacheLevel cached;
+		memcpy(&cached, file.data() + sizeof(TextureCacheHeader) + i * sizeof(TextureCacheLevel), sizeof(cached));
+
+		TextureLevel& level = view.levels[i];
+		if (cached.width != level.width || cached.height != level.height || cached.size != level.size ||
+			cached.offset % LEVEL_ALIGNMENT != 0 || cached.offset > header.dataSize || cached.size > header.dataSize - cached.offset) {
+			close();
+			return false;
+		}
+
+		level.offset = cached.offset;
+	}
+
+	view.format = format;
+	view.width = header.width;
+	view.height = header.height;
+	view.data = reinterpret_cast<const unsigned char*>(file.data()) + header.dataOffset;
+	view.dataSize = header.dataSize;
+	return true;
+}
+
+void TextureCache::close() {
+	file.close();
+	view = TextureView();
+}
+
+bool TextureCache::write(const std::string& cachePath, const std::string& sourcePath, const TextureView& texture) {
+	if (texture.levels.empty() || texture.levels.size() > MAX_CACHED_LEVELS) {
+		return false;
+	}
+
+	FileStatus sourceStatus;
+	TextureCacheHeader header = {};
+	if (!getFileStatus(sourcePath, sourceStatus) || !hashFile(sourcePath, header.sourceHash)) {
+		return false;
+	}
+
+	memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(TEXTURE_CACHE_MAGIC));
+	header.version = VERSION;
+	header.sourceSize = sourceStatus.size;
+	header.sourceModifiedTime = sourceStatus.modifiedTime;
+
+	header.format = static_cast<uint32_t>(texture.format);
+	header.width = texture.width;
+	header.height = texture.height;
+	header.levelCount = static_cast<uint32_t>(texture.levels.size());
+
+	std::vector<TextureCacheLevel> levelIndex(texture.levels.size());
+	for (size_t i = 0; i < texture.levels.size(); i++) {
+		levelIndex[i].width = texture.levels[i].width;
+		levelIndex[i].height = texture.levels[i].height;
+		levelIndex[i].offset = texture.levels[i].offset;
+		levelIndex[i].size = texture.levels[i].size;
+	}
+
+	uint64_t levelIndexBytes = levelIndex.size() * sizeof(TextureCacheLevel);
+	header.dataOffset = alignUp(sizeof(TextureCacheHeader) + levelIndexBytes, LEVEL_ALIGNMENT);
+	header.dataSize = texture.dataSize;
+
+	static const char padding[LEVEL_ALIGNMENT] = {};
+
+	std::vector<FileChunk> chunks = {
+		{ &header, sizeof(header) },
+		{ levelIndex.data(), static_cast<size_t>(levelIndexBytes) },
+		{ padding, static_cast<size_t>(header.dataOffset - sizeof(header) - levelIndexBytes) },
+		{ texture.data, static_cast<size_t>(texture.dataSize) }
+	};
+
+	return writeFileAtomically(cachePath, chunks);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// One mip level inside a texture's data blob. Offsets are relative to the start of the blob and
+// aligned so the level can be used directly as a VkBufferImageCopy::bufferOffset
+struct TextureLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// Complete mip chain of a 2D texture stored back to back in one blob. The blob either belongs to
+// the caller or points into a mapped texture cache file.
+struct TextureView {
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<TextureLevel> levels;
+
+	const unsigned char* data = nullptr;
+	uint64_t dataSize = 0;
+};
+
+// Number of levels in a full mip chain down to 1x1
+uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+// Storage of the texture formats the cache may hold. Uncompressed formats are 1x1 blocks
+struct TextureFormatInfo {
+	uint32_t blockWidth;
+	uint32_t blockHeight;
+	uint32_t bytesPerBlock;
+};
+
+// Returns false for formats the cache does not know
+bool getTextureFormatInfo(VkFormat format, TextureFormatInfo& info);
+
+// Computes the position of every level of a full mip chain of format, with each level starting on
+// a 16-byte boundary. Levels of block-compressed formats are padded to whole blocks. Returns the
+// total blob size
+uint64_t layoutMipChain(uint32_t width, uint32_t height, VkFormat format, std::vector<TextureLevel>& levels);
+
+// Cooked copy of a decoded texture and its mip chain, loosely modelled on KTX2:
+//
+//   TextureCacheHeader | level index | level 0 | level 1 | ... | level n-1
+//
+// Levels are stored largest first, tightly packed row by row, exactly as vkCmdCopyBufferToImage
+// consumes them with bufferRowLength = 0, so the blob can be copied into a staging buffer as is.
+// Like the mesh cache, the header records the source file's size, modification time and content
+// hash. A cache whose version or format differs is ignored.
+class TextureCache {
+public:
+	// Version 2: mip chains are filtered in linear space
+	static const uint32_t VERSION = 2;
+
+	// Maps cachePath and validates it against sourcePath and format. On success getView() points
+	// into the mapping, which stays valid until close() or destruction
+	bool open(const std::string& cachePath, const std::string& sourcePath, VkFormat format);
+	void close();
+
+	const TextureView& getView() const {
+		return view;
+	}
+
+	static bool write(const std::string& cachePath, const std::string& sourcePath, const TextureView& texture);
+
+private:
+	MappedFile file;
+	TextureView view;
+};
@@ -0,0 +1,661 @@
+#include "TextureCompressor.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const uint32_t BLOCK_SIZE = 4;
+const uint32_t BLOCK_TEXELS = BLOCK_SIZE * BLOCK_SIZE;
+
+// Interpolation weights of the BC7 4-bit index precision, in 64ths of the second endpoint
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// ETC1 modifier tables, also used by the ETC2 individual and differential modes
+const int ETC_MODIFIERS[8][4] = {
+	{ 2, 8, -2, -8 },
+	{ 5, 17, -5, -17 },
+	{ 9, 29, -9, -29 },
+	{ 13, 42, -13, -42 },
+	{ 18, 60, -18, -60 },
+	{ 24, 80, -24, -80 },
+	{ 33, 106, -33, -106 },
+	{ 47, 183, -47, -183 }
+};
+
+int clampByte(int value) {
+	return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Copies a 4x4 block of RGBA8 texels, clamping coordinates to the level
+void loadBlock(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[BLOCK_TEXELS * 4]) {
+	for (uint32_t y = 0; y < BLOCK_SIZE; y++) {
+		uint32_t sourceY = std::min(blockY * BLOCK_SIZE + y, height - 1);
+		for (uint32_t x = 0; x < BLOCK_SIZE; x++) {
+			uint32_t sourceX = std::min(blockX * BLOCK_SIZE + x, width - 1);
+			memcpy(block + (y * BLOCK_SIZE + x) * 4, pixels + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+		}
+	}
+}
+
+void computeBounds(const uint8_t block[BLOCK_TEXELS * 4], uint8_t minColor[4], uint8_t maxColor[4]) {
+#ifdef TEXTURE_COMPRESSOR_SSE2
+	const __m128i* rows = reinterpret_cast<const __m128i*>(block);
+	__m128i row0 = _mm_loadu_si128(rows + 0);
+	__m128i row1 = _mm_loadu_si128(rows + 1);
+	__m128i row2 = _mm_loadu_si128(rows + 2);
+	__m128i row3 = _mm_loadu_si128(rows + 3);
+
+	__m128i low = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	__m128i high = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+	low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+	low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+	high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+	high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+
+	uint32_t packedMin = static_cast<uint32_t>(_mm_cvtsi128_si32(low));
+	uint32_t packedMax = static_cast<uint32_t>(_mm_cvtsi128_si32(high));
+	memcpy(minColor, &packedMin, 4);
+	memcpy(maxColor, &packedMax, 4);
+#else
+	memcpy(minColor, block, 4);
+	memcpy(maxColor, block, 4);
+	for (uint32_t i = 1; i < BLOCK_TEXELS; i++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+			maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+		}
+	}
+#endif
+}
+
+// Picks endpoints on the diagonal of the bounding box that best follows the texels: channels that
+// fall while the widest channel rises get their minimum and maximum swapped. The endpoints are
+// then inset by 1/insetDivisor of the range, as the extremes are rarely hit exactly.
+void chooseEndpoints(const uint8_t block[BLOCK_TEXELS * 4], uint32_t channelCount, int insetDivisor, int endpoint0[4], int endpoint1[4]) {
+	uint8_t minColor[4], maxColor[4];
+	computeBounds(block, minColor, maxColor);
+
+	uint32_t widest = 0;
+	for (uint32_t c = 1; c < channelCount; c++) {
+		if (maxColor[c] - minColor[c] > maxColor[widest] - minColor[widest]) {
+			widest = c;
+		}
+	}
+
+	int center[4];
+	for (uint32_t c = 0; c < 4; c++) {
+		center[c] = (minColor[c] + maxColor[c] + 1) / 2;
+	}
+
+	for (uint32_t c = 0; c < 4; c++) {
+		int inset = (maxColor[c] - minColor[c]) / insetDivisor;
+		endpoint0[c] = maxColor[c] - inset;
+		endpoint1[c] = minColor[c] + inset;
+
+		if (c == widest || c >= channelCount) {
+			continue;
+		}
+
+		int covariance = 0;
+		for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+			covariance += (block[i * 4 + widest] - center[widest]) * (block[i * 4 + c] - center[c]);
+		}
+
+		if (covariance < 0) {
+			std::swap(endpoint0[c], endpoint1[c]);
+		}
+	}
+}
+
+// Assigns every texel the nearest palette entry by squared RGB(A) distance and returns the summed
+// error. This is the inner loop of every encoder, so SSE2 evaluates four texels per entry at once
+uint32_t selectIndices(const uint8_t block[BLOCK_TEXELS * 4], const uint8_t palette[][4], uint32_t paletteSize, bool withAlpha,
+	uint8_t indices[BLOCK_TEXELS]) {
+	uint32_t totalError = 0;
+
+#ifdef TEXTURE_COMPRESSOR_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i channelMask = _mm_set1_epi32(withAlpha ? -1 : 0x00FFFFFF);
+
+	__m128i entries[16];
+	for (uint32_t i = 0; i < paletteSize; i++) {
+		int32_t color;
+		memcpy(&color, palette[i], 4);
+		entries[i] = _mm_unpacklo_epi8(_mm_and_si128(_mm_set1_epi32(color), channelMask), zero);
+	}
+
+	for (uint32_t group = 0; group < BLOCK_TEXELS / 4; group++) {
+		__m128i texels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block) + group), channelMask);
+		__m128i texelsLow = _mm_unpacklo_epi8(texels, zero);
+		__m128i texelsHigh = _mm_unpackhi_epi8(texels, zero);
+
+		__m128i bestError = _mm_set1_epi32(INT32_MAX);
+		__m128i bestIndex = zero;
+
+		for (uint32_t i = 0; i < paletteSize; i++) {
+			__m128i differenceLow = _mm_sub_epi16(texelsLow, entries[i]);
+			__m128i differenceHigh = _mm_sub_epi16(texelsHigh, entries[i]);
+
+			// Pairwise sums of squares (r^2 + g^2, b^2 + a^2) per texel, then add the pairs
+			__m128 squaresLow = _mm_castsi128_ps(_mm_madd_epi16(differenceLow, differenceLow));
+			__m128 squaresHigh = _mm_castsi128_ps(_mm_madd_epi16(differenceHigh, differenceHigh));
+			__m128i even = _mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd = _mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(3, 1, 3, 1)));
+			__m128i error = _mm_add_epi32(even, odd);
+
+			__m128i better = _mm_cmplt_epi32(error, bestError);
+			bestError = _mm_or_si128(_mm_and_si128(better, error), _mm_andnot_si128(better, bestError));
+			bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(static_cast<int>(i))), _mm_andnot_si128(better, bestIndex));
+		}
+
+		int32_t errors[4], groupIndices[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(errors), bestError);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(groupIndices), bestIndex);
+
+		for (uint32_t i = 0; i < 4; i++) {
+			indices[group * 4 + i] = static_cast<uint8_t>(groupIndices[i]);
+			totalError += static_cast<uint32_t>(errors[i]);
+		}
+	}
+#else
+	uint32_t channelCount = withAlpha ? 4 : 3;
+
+	for (uint32_t texel = 0; texel < BLOCK_TEXELS; texel++) {
+		uint32_t bestError = UINT32_MAX;
+		for (uint32_t i = 0; i < paletteSize; i++) {
+			uint32_t error = 0;
+			for (uint32_t c = 0; c < channelCount; c++) {
+				int difference = block[texel * 4 + c] - palette[i][c];
+				error += static_cast<uint32_t>(difference * difference);
+			}
+
+			if (error < bestError) {
+				bestError = error;
+				indices[texel] = static_cast<uint8_t>(i);
+			}
+		}
+		totalError += bestError;
+	}
+#endif
+
+	return totalError;
+}
+
+// Least squares endpoints for fixed indices, where weights[index] is the share of endpoint 1.
+// Returns false if the indices do not constrain both endpoints
+bool refitEndpoints(const uint8_t block[BLOCK_TEXELS * 4], const uint8_t indices[BLOCK_TEXELS], const float* weights, uint32_t channelCount,
+	int endpoint0[4], int endpoint1[4]) {
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+
+	for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+		float b = weights[indices[i]];
+		float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (uint32_t c = 0; c < channelCount; c++) {
+			ax[c] += a * block[i * 4 + c];
+			bx[c] += b * block[i * 4 + c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (determinant < 1e-6f) {
+		return false;
+	}
+
+	for (uint32_t c = 0; c < channelCount; c++) {
+		endpoint0[c] = clampByte(static_cast<int>((ax[c] * bb - bx[c] * ab) / determinant + 0.5f));
+		endpoint1[c] = clampByte(static_cast<int>((bx[c] * aa - ax[c] * ab) / determinant + 0.5f));
+	}
+	return true;
+}
+
+uint16_t packRgb565(const int color[4]) {
+	return static_cast<uint16_t>(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+void unpackRgb565(uint16_t packed, uint8_t color[4]) {
+	uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = static_cast<uint8_t>(r << 3 | r >> 2);
+	color[1] = static_cast<uint8_t>(g << 2 | g >> 4);
+	color[2] = static_cast<uint8_t>(b << 3 | b >> 2);
+	color[3] = 255;
+}
+
+// Writes a four color BC1 block for the given endpoints and returns its error
+uint32_t writeBc1Block(const uint8_t block[BLOCK_TEXELS * 4], const int endpoint0[4], const int endpoint1[4], uint8_t indices[BLOCK_TEXELS],
+	uint8_t output[8]) {
+	uint16_t color0 = packRgb565(endpoint0);
+	uint16_t color1 = packRgb565(endpoint1);
+	if (color0 < color1) {
+		std::swap(color0, color1);
+	}
+
+	uint8_t palette[4][4];
+	unpackRgb565(color0, palette[0]);
+	unpackRgb565(color1, palette[1]);
+	for (uint32_t c = 0; c < 4; c++) {
+		palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c] + 1) / 3);
+		palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+	}
+
+	uint32_t error;
+	if (color0 == color1) {
+		// Equal endpoints would select the three color mode, where only index 0 is safe to use
+		error = selectIndices(block, palette, 1, false, indices);
+	}
+	else {
+		error = selectIndices(block, palette, 4, false, indices);
+	}
+
+	uint32_t indexBits = 0;
+	for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+		indexBits |= static_cast<uint32_t>(indices[i]) << (2 * i);
+	}
+
+	output[0] = static_cast<uint8_t>(color0);
+	output[1] = static_cast<uint8_t>(color0 >> 8);
+	output[2] = static_cast<uint8_t>(color1);
+	output[3] = static_cast<uint8_t>(color1 >> 8);
+	memcpy(output + 4, &indexBits, 4);
+	return error;
+}
+
+void encodeBc1Block(const uint8_t block[BLOCK_TEXELS * 4], uint8_t output[8]) {
+	// Share of the second endpoint for each BC1 index in four color mode
+	static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	int endpoint0[4], endpoint1[4];
+	chooseEndpoints(block, 3, 16, endpoint0, endpoint1);
+
+	uint8_t indices[BLOCK_TEXELS];
+	uint32_t error = writeBc1Block(block, endpoint0, endpoint1, indices, output);
+
+	if (error > 0 && refitEndpoints(block, indices, WEIGHTS, 3, endpoint0, endpoint1)) {
+		uint8_t refined[8];
+		if (writeBc1Block(block, endpoint0, endpoint1, indices, refined) < error) {
+			memcpy(output, refined, sizeof(refined));
+		}
+	}
+}
+
+// BC4 style alpha block of BC3, always in the eight value mode
+void encodeAlphaBlock(const uint8_t block[BLOCK_TEXELS * 4], uint8_t output[8]) {
+	int minAlpha = 255, maxAlpha = 0;
+	for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+		minAlpha = std::min(minAlpha, static_cast<int>(block[i * 4 + 3]));
+		maxAlpha = std::max(maxAlpha, static_cast<int>(block[i * 4 + 3]));
+	}
+
+	memset(output, 0, 8);
+	output[0] = static_cast<uint8_t>(maxAlpha);
+	output[1] = static_cast<uint8_t>(minAlpha);
+	if (maxAlpha == minAlpha) {
+		return;
+	}
+
+	int range = maxAlpha - minAlpha;
+	uint64_t indexBits = 0;
+	for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+		// Step 0 is the minimum and step 7 the maximum. Index 0 is alpha0 (the maximum), index 1
+		// alpha1 and indices 2 to 7 the interpolated values from the maximum down
+		int step = ((block[i * 4 + 3] - minAlpha) * 14 + range) / (2 * range);
+		uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+		indexBits |= index << (3 * i);
+	}
+
+	for (uint32_t i = 0; i < 6; i++) {
+		output[2 + i] = static_cast<uint8_t>(indexBits >> (8 * i));
+	}
+}
+
+void encodeBc3Block(const uint8_t block[BLOCK_TEXELS * 4], uint8_t output[16]) {
+	encodeAlphaBlock(block, output);
+	encodeBc1Block(block, output + 8);
+}
+
+class BlockBitWriter {
+public:
+	explicit BlockBitWriter(uint8_t* output) : output(output) {}
+
+	void write(uint32_t value, uint32_t bitCount) {
+		for (uint32_t i = 0; i < bitCount; i++, position++) {
+			output[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+		}
+	}
+
+private:
+	uint8_t* output;
+	uint32_t position = 0;
+};
+
+struct Bc7Mode6Endpoints {
+	// 7-bit RGBA endpoints plus the shared low bit of each endpoint
+	int quantized[2][4];
+	int pBits[2];
+};
+
+// Quantizes both endpoints for all four p-bit combinations and keeps the one with the lowest error
+uint32_t fitBc7Mode6(const uint8_t block[BLOCK_TEXELS * 4], const int endpoint0[4], const int endpoint1[4],
+	Bc7Mode6Endpoints& best, uint8_t bestIndices[BLOCK_TEXELS]) {
+	const int* endpoints[2] = { endpoint0, endpoint1 };
+	uint32_t bestError = UINT32_MAX;
+
+	for (int combination = 0; combination < 4; combination++) {
+		Bc7Mode6Endpoints candidate;
+		uint8_t expanded[2][4];
+
+		for (int e = 0; e < 2; e++) {
+			candidate.pBits[e] = (combination >> e) & 1;
+			for (int c = 0; c < 4; c++) {
+				int quantized = std::min(std::max((endpoints[e][c] - candidate.pBits[e] + 1) >> 1, 0), 127);
+				candidate.quantized[e][c] = quantized;
+				expanded[e][c] = static_cast<uint8_t>(quantized << 1 | candidate.pBits[e]);
+			}
+		}
+
+		uint8_t palette[16][4];
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 4; c++) {
+				palette[i][c] = static_cast<uint8_t>(((64 - BC7_WEIGHTS[i]) * expanded[0][c] + BC7_WEIGHTS[i] * expanded[1][c] + 32) >> 6);
+			}
+		}
+
+		uint8_t indices[BLOCK_TEXELS];
+		uint32_t error = selectIndices(block, palette, 16, true, indices);
+		if (error < bestError) {
+			bestError = error;
+			best = candidate;
+			memcpy(bestIndices, indices, BLOCK_TEXELS);
+		}
+	}
+
+	return bestError;
+}
+
+// BC7 mode 6: a single subset with RGBA 7.7.7.7 endpoints, a p-bit per endpoint and 4-bit indices.
+// Fast encoders use it for all blocks since it handles both opaque and alpha content well.
+void encodeBc7Block(const uint8_t block[BLOCK_TEXELS * 4], uint8_t output[16]) {
+	float weights[16];
+	for (int i = 0; i < 16; i++) {
+		weights[i] = BC7_WEIGHTS[i] / 64.0f;
+	}
+
+	int endpoint0[4], endpoint1[4];
+	chooseEndpoints(block, 4, 32, endpoint0, endpoint1);
+
+	Bc7Mode6Endpoints endpoints;
+	uint8_t indices[BLOCK_TEXELS];
+	uint32_t error = fitBc7Mode6(block, endpoint0, endpoint1, endpoints, indices);
+
+	if (error > 0 && refitEndpoints(block, indices, weights, 4, endpoint0, endpoint1)) {
+		Bc7Mode6Endpoints refined;
+		uint8_t refinedIndices[BLOCK_TEXELS];
+		if (fitBc7Mode6(block, endpoint0, endpoint1, refined, refinedIndices) < error) {
+			endpoints = refined;
+			memcpy(indices, refinedIndices, BLOCK_TEXELS);
+		}
+	}
+
+	// The most significant bit of the first index is implied zero, so swap the endpoints if needed
+	if (indices[0] & 8) {
+		std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+		std::swap(endpoints.pBits[0], endpoints.pBits[1]);
+		for (uint32_t i = 0; i < BLOCK_TEXELS; i++) {
+			indices[i] = static_cast<uint8_t>(15 - indices[i]);
+		}
+	}
+
+	memset(output, 0, 16);
+	BlockBitWriter writer(output);
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(static_cast<uint32_t>(endpoints.quantized[0][c]), 7);
+		writer.write(static_cast<uint32_t>(endpoints.quantized[1][c]), 7);
+	}
+	writer.write(static_cast<uint32_t>(endpoints.pBits[0]), 1);
+	writer.write(static_cast<uint32_t>(endpoints.pBits[1]), 1);
+	writer.write(indices[0], 3);
+	for (uint32_t i = 1; i < BLOCK_TEXELS; i++) {
+		writer.write(indices[i], 4);
+	}
+}
+
+// Texels of one half of an ETC block: the left and right 2x4 halves, or the top and bottom 4x2
+// halves when flipped
+void getEtcSubblockTexels(bool flip, uint32_t subblock, uint32_t texels[8]) {
+	uint32_t count = 0;
+	for (uint32_t y = 0; y < BLOCK_SIZE; y++) {
+		for (uint32_t x = 0; x < BLOCK_SIZE; x++) {
+			if ((flip ? y / 2 : x / 2) == subblock) {
+				texels[count++] = y * BLOCK_SIZE + x;
+			}
+		}
+	}
+}
+
+// Chooses the modifier table and per-texel modifiers for a half block with the given base color
+uint32_t fitEtcSubblock(const uint8_t block[BLOCK_TEXELS * 4], const uint32_t texels[8], const int base[3],
+	uint32_t& bestTable, uint8_t selectors[BLOCK_TEXELS]) {
+	uint32_t bestError = UINT32_MAX;
+
+	for (uint32_t table = 0; table < 8; table++) {
+		uint32_t tableError = 0;
+		uint8_t tableSelectors[8];
+
+		for (uint32_t i = 0; i < 8; i++) {
+			const uint8_t* texel = block + texels[i] * 4;
+			uint32_t texelError = UINT32_MAX;
+
+			for (uint32_t s = 0; s < 4; s++) {
+				uint32_t error = 0;
+				for (uint32_t c = 0; c < 3; c++) {
+					int difference = clampByte(base[c] + ETC_MODIFIERS[table][s]) - texel[c];
+					error += static_cast<uint32_t>(difference * difference);
+				}
+
+				if (error < texelError) {
+					texelError = error;
+					tableSelectors[i] = static_cast<uint8_t>(s);
+				}
+			}
+			tableError += texelError;
+		}
+
+		if (tableError < bestError) {
+			bestError = tableError;
+			bestTable = table;
+			for (uint32_t i = 0; i < 8; i++) {
+				selectors[texels[i]] = tableSelectors[i];
+			}
+		}
+	}
+
+	return bestError;
+}
+
+// ETC2 RGB8 block using the ETC1 compatible individual and differential modes. Bases are the
+// quantized half block averages; the differential mode is only used when the second base is in
+// range, so the block never aliases one of the ETC2-only modes
+void encodeEtc2Block(const uint8_t block[BLOCK_TEXELS * 4], uint8_t output[8]) {
+	uint64_t bestBits = 0;
+	uint32_t bestError = UINT32_MAX;
+
+	for (int flip = 0; flip < 2; flip++) {
+		uint32_t texels[2][8];
+		int average[2][3];
+		for (uint32_t subblock = 0; subblock < 2; subblock++) {
+			getEtcSubblockTexels(flip != 0, subblock, texels[subblock]);
+			for (uint32_t c = 0; c < 3; c++) {
+				int sum = 0;
+				for (uint32_t i = 0; i < 8; i++) {
+					sum += block[texels[subblock][i] * 4 + c];
+				}
+				average[subblock][c] = (sum + 4) / 8;
+			}
+		}
+
+		for (int differential = 0; differential < 2; differential++) {
+			int quantized[2][3], base[2][3];
+			bool representable = true;
+
+			for (uint32_t subblock = 0; subblock < 2; subblock++) {
+				for (uint32_t c = 0; c < 3; c++) {
+					if (differential) {
+						int q = (average[subblock][c] * 31 + 127) / 255;
+						quantized[subblock][c] = q;
+						base[subblock][c] = q << 3 | q >> 2;
+					}
+					else {
+						int q = (average[subblock][c] * 15 + 127) / 255;
+						quantized[subblock][c] = q;
+						base[subblock][c] = q << 4 | q;
+					}
+				}
+			}
+
+			if (differential) {
+				for (uint32_t c = 0; c < 3; c++) {
+					int delta = quantized[1][c] - quantized[0][c];
+					representable = representable && delta >= -4 && delta <= 3;
+				}
+			}
+
+			if (!representable) {
+				continue;
+			}
+
+			uint32_t tables[2];
+			uint8_t selectors[BLOCK_TEXELS];
+			uint32_t error = fitEtcSubblock(block, texels[0], base[0], tables[0], selectors) +
+				fitEtcSubblock(block, texels[1], base[1], tables[1], selectors);
+
+			if (error >= bestError) {
+				continue;
+			}
+
+			uint64_t bits = 0;
+			for (uint32_t c = 0; c < 3; c++) {
+				if (differential) {
+					uint64_t delta = static_cast<uint64_t>(quantized[1][c] - quantized[0][c]) & 7;
+					bits |= static_cast<uint64_t>(quantized[0][c]) << (59 - 8 * c) | delta << (56 - 8 * c);
+				}
+				else {
+					bits |= static_cast<uint64_t>(quantized[0][c]) << (60 - 8 * c) | static_cast<uint64_t>(quantized[1][c]) << (56 - 8 * c);
+				}
+			}
+
+			bits |= static_cast<uint64_t>(tables[0]) << 37 | static_cast<uint64_t>(tables[1]) << 34;
+			bits |= static_cast<uint64_t>(differential) << 33 | static_cast<uint64_t>(flip) << 32;
+
+			// Selector bits are stored column by column, most significant bits in the upper half
+			for (uint32_t y = 0; y < BLOCK_SIZE; y++) {
+				for (uint32_t x = 0; x < BLOCK_SIZE; x++) {
+					uint64_t selector = selectors[y * BLOCK_SIZE + x];
+					uint32_t bit = x * BLOCK_SIZE + y;
+					bits |= (selector >> 1) << (16 + bit) | (selector & 1) << bit;
+				}
+			}
+
+			bestError = error;
+			bestBits = bits;
+		}
+	}
+
+	for (uint32_t i = 0; i < 8; i++) {
+		output[i] = static_cast<uint8_t>(bestBits >> (56 - 8 * i));
+	}
+}
+
+typedef void (*BlockEncoder)(const uint8_t* block, uint8_t* output);
+
+BlockEncoder getBlockEncoder(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		return encodeBc1Block;
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		return encodeBc3Block;
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return encodeBc7Block;
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		return encodeEtc2Block;
+	default:
+		return nullptr;
+	}
+}
+
+struct BlockRow {
+	uint32_t level;
+	uint32_t row;
+};
+
+} // namespace
+
+bool isCompressibleFormat(VkFormat format) {
+	return getBlockEncoder(format) != nullptr;
+}
+
+bool isOpaque(const unsigned char* pixels, size_t texelCount) {
+	for (size_t i = 0; i < texelCount; i++) {
+		if (pixels[i * 4 + 3] != 255) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void compressTexture(const TextureView& source, VkFormat format, std::vector<unsigned char>& data, TextureView& destination,
+	unsigned threadCount) {
+	BlockEncoder encoder = getBlockEncoder(format);
+	TextureFormatInfo info;
+	getTextureFormatInfo(format, info);
+
+	destination = TextureView();
+	destination.format = format;
+	destination.width = source.width;
+	destination.height = source.height;
+	data.assign(static_cast<size_t>(layoutMipChain(source.width, source.height, format, destination.levels)), 0);
+	destination.data = data.data();
+	destination.dataSize = data.size();
+
+	// Rows of blocks are the unit of work, so small levels do not each need their own thread
+	std::vector<BlockRow> rows;
+	for (uint32_t level = 0; level < destination.levels.size(); level++) {
+		uint32_t blockRows = (destination.levels[level].height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		for (uint32_t row = 0; row < blockRows; row++) {
+			rows.push_back({ level, row });
+		}
+	}
+
+	size_t workerCount = std::min<size_t>(resolveThreadCount(threadCount), rows.size());
+
+	runParallel(workerCount, [&](size_t worker) {
+		size_t begin = rows.size() * worker / workerCount;
+		size_t end = rows.size() * (worker + 1) / workerCount;
+
+		uint8_t block[BLOCK_TEXELS * 4];
+		for (size_t i = begin; i < end; i++) {
+			const TextureLevel& sourceLevel = source.levels[rows[i].level];
+			const TextureLevel& destinationLevel = destination.levels[rows[i].level];
+			uint32_t blocksWide = (destinationLevel.width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+			unsigned char* output = data.data() + destinationLevel.offset + static_cast<size_t>(rows[i].row) * blocksWide * info.bytesPerBlock;
+			for (uint32_t x = 0; x < blocksWide; x++) {
+				loadBlock(source.data + sourceLevel.offset, sourceLevel.width, sourceLevel.height, x, rows[i].row, block);
+				encoder(block, output + x * info.bytesPerBlock);
+			}
+		}
+	});
+}
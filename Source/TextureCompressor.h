@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "TextureCache.h"
+
+// Whether compressTexture can encode to format: BC1, BC3, BC7 or ETC2 RGB8
+bool isCompressibleFormat(VkFormat format);
+
+// Whether every texel of an RGBA8 image has full alpha, so formats without alpha can be used
+bool isOpaque(const unsigned char* pixels, size_t texelCount);
+
+// Encodes every level of an RGBA8 mip chain into the block-compressed format, splitting the rows
+// of blocks across threadCount workers (0 uses every hardware thread). Texels past the edge of
+// levels that are not a multiple of the block size repeat the last row and column.
+// The result is laid out by layoutMipChain and stored in data, which destination points at.
+void compressTexture(const TextureView& source, VkFormat format, std::vector<unsigned char>& data, TextureView& destination,
+	unsigned threadCount = 0);
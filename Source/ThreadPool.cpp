@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+#include "Parallel.h"
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+	unsigned workerCount = resolveThreadCount(threadCount) - 1;
+	workers.reserve(workerCount);
+	for (unsigned i = 0; i < workerCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+	if (count == 0) {
+		return;
+	}
+
+	size_t remaining = count;
+	std::exception_ptr error;
+
+	auto execute = [&](size_t index) {
+		std::exception_ptr taskError;
+		try {
+			task(index);
+		}
+		catch (...) {
+			taskError = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (taskError && !error) {
+			error = taskError;
+		}
+		if (--remaining == 0) {
+			finished.notify_all();
+		}
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 1; i < count; i++) {
+			queue.push_back([&execute, i]() { execute(i); });
+		}
+	}
+	wake.notify_all();
+
+	execute(0);
+
+	// Help with the remaining jobs instead of idling, then wait for those still running elsewhere
+	std::unique_lock<std::mutex> lock(mutex);
+	while (remaining > 0) {
+		if (!runQueuedJob(lock)) {
+			finished.wait(lock);
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		if (!runQueuedJob(lock)) {
+			wake.wait(lock);
+		}
+	}
+}
+
+bool ThreadPool::runQueuedJob(std::unique_lock<std::mutex>& lock) {
+	if (queue.empty()) {
+		return false;
+	}
+
+	std::function<void()> job = std::move(queue.front());
+	queue.pop_front();
+
+	lock.unlock();
+	job();
+	lock.lock();
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads kept alive between jobs, for work that repeats every frame where
+// spawning threads (as runParallel does) would cost more than the work itself.
+class ThreadPool {
+public:
+	// threadCount includes the calling thread, which takes part in run(). 0 uses every hardware thread
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned getThreadCount() const {
+		return static_cast<unsigned>(workers.size()) + 1;
+	}
+
+	// Runs task(i) for i in [0, count) on the workers and the calling thread and returns once all
+	// of them finished. The first exception thrown by a task is rethrown here
+	void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::deque<std::function<void()>> queue;
+	bool stopping = false;
+
+	void workerLoop();
+
+	// Pops and runs one queued job. Returns false if the queue was empty
+	bool runQueuedJob(std::unique_lock<std::mutex>& lock);
+};
@@ -0,0 +1,289 @@
+#include "UploadBatch.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+UploadBatch::UploadBatch(VkDevice device, DeviceMemoryAllocator& allocator, const UploadQueue& transferQueue, const UploadQueue& graphicsQueue)
+	: device(device), allocator(allocator), transfer(transferQueue), graphics(graphicsQueue) {
+
+	transferCommandBuffer = allocateCommandBuffer(transfer.commandPool);
+	graphicsCommandBuffer = usesSeparateQueue() ? allocateCommandBuffer(graphics.commandPool) : transferCommandBuffer;
+
+	if (usesSeparateQueue()) {
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &transferComplete) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload semaphore!");
+		}
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload fence!");
+	}
+}
+
+UploadBatch::~UploadBatch() {
+	if (submitted) {
+		wait();
+	}
+	releaseResources();
+
+	vkDestroyFence(device, fence, nullptr);
+	if (transferComplete != VK_NULL_HANDLE) {
+		vkDestroySemaphore(device, transferComplete, nullptr);
+	}
+
+	vkFreeCommandBuffers(device, transfer.commandPool, 1, &transferCommandBuffer);
+	if (usesSeparateQueue()) {
+		vkFreeCommandBuffers(device, graphics.commandPool, 1, &graphicsCommandBuffer);
+	}
+}
+
+VkCommandBuffer UploadBatch::allocateCommandBuffer(VkCommandPool pool) {
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate upload command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+StagingRegion UploadBatch::allocateStaging(VkDeviceSize size) {
+	if (submitted) {
+		throw std::logic_error("upload batch already submitted!");
+	}
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	Allocation memory = allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationKind::Linear);
+	vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+
+	stagingBuffers.push_back(buffer);
+	stagingMemory.push_back(memory);
+	stagedBytes += size;
+
+	StagingRegion region = {};
+	region.buffer = buffer;
+	region.size = size;
+	region.mapped = memory.mapped;
+	return region;
+}
+
+void UploadBatch::copyBuffer(const StagingRegion& staging, VkDeviceSize stagingOffset, VkBuffer dstBuffer, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = stagingOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(transferCommandBuffer, staging.buffer, dstBuffer, 1, &copyRegion);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dstBuffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	if (!usesSeparateQueue()) {
+		vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		return;
+	}
+
+	// Release on the transfer queue, acquire on the graphics queue
+	barrier.srcQueueFamilyIndex = transfer.familyIndex;
+	barrier.dstQueueFamilyIndex = graphics.familyIndex;
+
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void UploadBatch::uploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	StagingRegion staging = allocateStaging(size);
+	memcpy(staging.mapped, data, static_cast<size_t>(size));
+	copyBuffer(staging, 0, dstBuffer, size, dstStage, dstAccess);
+}
+
+void UploadBatch::copyImage(const StagingRegion& staging, VkImage image, uint32_t mipLevels, const std::vector<VkBufferImageCopy>& regions,
+	VkImageLayout finalLayout) {
+
+	VkPipelineStageFlags dstStage;
+	VkAccessFlags dstAccess;
+	if (finalLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dstAccess = VK_ACCESS_SHADER_READ_BIT;
+	}
+	else if (finalLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dstAccess = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	else {
+		throw std::invalid_argument("unsupported final layout for image upload!");
+	}
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkCmdCopyBufferToImage(transferCommandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()), regions.data());
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = finalLayout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+
+	if (!usesSeparateQueue()) {
+		vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		return;
+	}
+
+	// The layout transition happens once, as part of the queue family ownership transfer
+	barrier.srcQueueFamilyIndex = transfer.familyIndex;
+	barrier.dstQueueFamilyIndex = graphics.familyIndex;
+
+	barrier.dstAccessMask = 0;
+	vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+VkCommandBuffer UploadBatch::graphicsCommands() {
+	if (submitted) {
+		throw std::logic_error("upload batch already submitted!");
+	}
+
+	return graphicsCommandBuffer;
+}
+
+void UploadBatch::submit() {
+	if (submitted) {
+		throw std::logic_error("upload batch already submitted!");
+	}
+
+	vkEndCommandBuffer(transferCommandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &transferCommandBuffer;
+
+	if (!usesSeparateQueue()) {
+		if (vkQueueSubmit(transfer.queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit upload batch!");
+		}
+		submitted = true;
+		return;
+	}
+
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &transferComplete;
+
+	if (vkQueueSubmit(transfer.queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload batch!");
+	}
+
+	vkEndCommandBuffer(graphicsCommandBuffer);
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo acquireInfo = {};
+	acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	acquireInfo.waitSemaphoreCount = 1;
+	acquireInfo.pWaitSemaphores = &transferComplete;
+	acquireInfo.pWaitDstStageMask = &waitStage;
+	acquireInfo.commandBufferCount = 1;
+	acquireInfo.pCommandBuffers = &graphicsCommandBuffer;
+
+	// Everything the graphics queue submits afterwards is ordered behind the acquires
+	if (vkQueueSubmit(graphics.queue, 1, &acquireInfo, fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload ownership acquire!");
+	}
+
+	submitted = true;
+}
+
+bool UploadBatch::poll() {
+	if (completed) {
+		return true;
+	}
+
+	if (!submitted || vkGetFenceStatus(device, fence) != VK_SUCCESS) {
+		return false;
+	}
+
+	releaseResources();
+	completed = true;
+	return true;
+}
+
+void UploadBatch::wait() {
+	if (!submitted) {
+		throw std::logic_error("waiting on an upload batch that was never submitted!");
+	}
+
+	if (!completed) {
+		vkWaitForFences(device, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		releaseResources();
+		completed = true;
+	}
+}
+
+void UploadBatch::releaseResources() {
+	for (size_t i = 0; i < stagingBuffers.size(); i++) {
+		vkDestroyBuffer(device, stagingBuffers[i], nullptr);
+		allocator.free(stagingMemory[i]);
+	}
+	stagingBuffers.clear();
+	stagingMemory.clear();
+}
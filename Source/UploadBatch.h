@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "DeviceMemoryAllocator.h"
+
+struct UploadQueue {
+	VkQueue queue;
+	uint32_t familyIndex;
+	VkCommandPool commandPool;
+};
+
+// Host visible staging memory handed out by an UploadBatch. Callers write (or read a file) straight
+// into mapped before recording the copy that consumes it.
+struct StagingRegion {
+	VkBuffer buffer;
+	VkDeviceSize size;
+	void* mapped;
+};
+
+// Records every staging copy and layout transition of a group of uploads into one command buffer
+// and submits them together with a single fence, instead of one blocking submission per resource.
+// When the transfer queue belongs to a different family than the graphics queue, the copies run on
+// the transfer queue and ownership of the destinations is released to the graphics family. The
+// matching acquires (and any extra graphics work such as mip blits) go into a graphics command
+// buffer that waits on the transfer submission. Staging buffers are released once the fence signals.
+class UploadBatch {
+public:
+	UploadBatch(VkDevice device, DeviceMemoryAllocator& allocator, const UploadQueue& transferQueue, const UploadQueue& graphicsQueue);
+	~UploadBatch();
+
+	UploadBatch(const UploadBatch&) = delete;
+	UploadBatch& operator=(const UploadBatch&) = delete;
+
+	StagingRegion allocateStaging(VkDeviceSize size);
+
+	// dstStage/dstAccess describe how the graphics queue uses the buffer first
+	void copyBuffer(const StagingRegion& staging, VkDeviceSize stagingOffset, VkBuffer dstBuffer, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	void uploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	// Copies the regions (offsets relative to the staging region) into a freshly created image and
+	// leaves all mip levels in finalLayout on the graphics queue. finalLayout may be
+	// TRANSFER_DST_OPTIMAL when more transfer work such as mip generation follows in graphicsCommands()
+	void copyImage(const StagingRegion& staging, VkImage image, uint32_t mipLevels, const std::vector<VkBufferImageCopy>& regions,
+		VkImageLayout finalLayout);
+
+	// Graphics queue command buffer recorded after all ownership acquires
+	VkCommandBuffer graphicsCommands();
+
+	void submit();
+
+	// Returns true once the uploads have completed and the staging memory has been released
+	bool poll();
+	void wait();
+
+	VkDeviceSize getStagedBytes() const {
+		return stagedBytes;
+	}
+
+private:
+	bool usesSeparateQueue() const {
+		return transfer.familyIndex != graphics.familyIndex;
+	}
+
+	VkCommandBuffer allocateCommandBuffer(VkCommandPool pool);
+	void releaseResources();
+
+	VkDevice device;
+	DeviceMemoryAllocator& allocator;
+	UploadQueue transfer;
+	UploadQueue graphics;
+
+	VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+	VkSemaphore transferComplete = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<Allocation> stagingMemory;
+	VkDeviceSize stagedBytes = 0;
+
+	bool submitted = false;
+	bool completed = false;
+};
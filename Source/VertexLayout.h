@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "MeshCache.h"
+
+// Size in bytes of the vertex attribute formats the layouts below may use, 0 for anything else
+constexpr uint32_t vertexFormatSize(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_R32_SFLOAT: return 4;
+	case VK_FORMAT_R32G32_SFLOAT: return 8;
+	case VK_FORMAT_R32G32B32_SFLOAT: return 12;
+	case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+	case VK_FORMAT_R16G16_SFLOAT: return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+	case VK_FORMAT_R16G16_UNORM: return 4;
+	case VK_FORMAT_R16G16B16A16_UNORM: return 8;
+	case VK_FORMAT_R16G16_SNORM: return 4;
+	case VK_FORMAT_R16G16B16A16_SNORM: return 8;
+	case VK_FORMAT_R8G8B8A8_UNORM: return 4;
+	case VK_FORMAT_R8G8B8A8_SNORM: return 4;
+	case VK_FORMAT_A2B10G10R10_SNORM_PACK32: return 4;
+	default: return 0;
+	}
+}
+
+template<uint32_t Location, VkFormat Format, uint32_t Offset>
+struct VertexAttribute {
+	static_assert(vertexFormatSize(Format) != 0, "unsupported vertex attribute format");
+
+	static VkVertexInputAttributeDescription describe(uint32_t binding) {
+		VkVertexInputAttributeDescription description = {};
+		description.binding = binding;
+		description.location = Location;
+		description.format = Format;
+		description.offset = Offset;
+		return description;
+	}
+
+	static constexpr bool fitsIn(uint32_t stride) {
+		return Offset + vertexFormatSize(Format) <= stride;
+	}
+};
+
+template<typename VertexType>
+constexpr bool attributesFit() {
+	return true;
+}
+
+template<typename VertexType, typename First, typename... Rest>
+constexpr bool attributesFit() {
+	return First::fitsIn(sizeof(VertexType)) && attributesFit<VertexType, Rest...>();
+}
+
+// Single description of a vertex struct from which the binding description, the attribute
+// descriptions and the mesh cache layout are all generated. Attributes that would read past the
+// end of the vertex fail to compile.
+template<typename VertexType, typename... Attributes>
+struct VertexLayout {
+	static_assert(attributesFit<VertexType, Attributes...>(), "vertex attribute extends past the end of the vertex");
+
+	static const uint32_t ATTRIBUTE_COUNT = sizeof...(Attributes);
+
+	static VkVertexInputBindingDescription getBindingDescription(uint32_t binding = 0, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX) {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = binding;
+		bindingDescription.stride = sizeof(VertexType);
+		bindingDescription.inputRate = inputRate;
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, sizeof...(Attributes)> getAttributeDescriptions(uint32_t binding = 0) {
+		return {{ Attributes::describe(binding)... }};
+	}
+
+	static MeshLayout getMeshLayout() {
+		auto attributeDescriptions = getAttributeDescriptions();
+
+		MeshLayout layout;
+		layout.vertexStride = sizeof(VertexType);
+		layout.attributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+		return layout;
+	}
+};
+
+// Maps value from [0, 1] to the full 16-bit UNORM range, rounding to nearest
+inline uint16_t quantizeUnorm16(float value) {
+	value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+}
+
+// IEEE 754 binary16 conversion with round to nearest even. Values too large for a half become
+// infinity, values too small flush through the denormal range to zero
+inline uint16_t floatToHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent == 0xFF) {
+		// Infinity or NaN, keeping NaNs quiet
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+	}
+
+	int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+	if (halfExponent >= 0x1F) {
+		return static_cast<uint16_t>(sign | 0x7C00);
+	}
+
+	if (halfExponent <= 0) {
+		if (halfExponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+
+		// Denormal: shift the mantissa including its implicit leading one
+		mantissa |= 0x800000;
+		uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+		uint32_t halfMantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))) {
+			halfMantissa++;
+		}
+		return static_cast<uint16_t>(sign | halfMantissa);
+	}
+
+	uint32_t half = sign | (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		// May carry into the exponent, which correctly rounds up to the next power of two or infinity
+		half++;
+	}
+	return static_cast<uint16_t>(half);
+}
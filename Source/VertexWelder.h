@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "Parallel.h"
+
+// Hash over the raw bytes of a vertex. Every 64-bit word goes through the murmur3 finalizer,
+// so positions on a regular grid (which differ in only a few mantissa bits) still spread across
+// the whole table.
+template<typename VertexType>
+uint64_t hashVertexBytes(const VertexType& vertex) {
+	static_assert(std::is_trivially_copyable<VertexType>::value, "vertices are hashed and compared bitwise");
+
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+	uint64_t hash = sizeof(VertexType) * 0x9E3779B97F4A7C15ull;
+
+	for (size_t offset = 0; offset < sizeof(VertexType); offset += sizeof(uint64_t)) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + offset, std::min(sizeof(uint64_t), sizeof(VertexType) - offset));
+
+		word ^= hash;
+		word ^= word >> 33;
+		word *= 0xFF51AFD7ED558CCDull;
+		word ^= word >> 33;
+		word *= 0xC4CEB9FE1A85EC53ull;
+		word ^= word >> 33;
+		hash = word;
+	}
+
+	return hash;
+}
+
+// Open addressing (linear probing) set of vertex ids keyed by the vertex bytes. Sized once up
+// front for a maximum number of unique vertices, so it never rehashes.
+template<typename VertexType>
+class VertexWeldTable {
+public:
+	static const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+	explicit VertexWeldTable(size_t maxVertices) {
+		size_t capacity = 16;
+		// Keep the load factor at or below one half
+		while (capacity < maxVertices * 2) {
+			capacity *= 2;
+		}
+		slots.assign(capacity, Slot{ 0, EMPTY });
+		mask = capacity - 1;
+	}
+
+	// Returns the id of the vertex equal to vertex, or registers it under newId if there is none
+	uint32_t findOrInsert(const VertexType& vertex, uint64_t hash, uint32_t newId, const std::vector<VertexType>& vertices) {
+		uint32_t tag = static_cast<uint32_t>(hash >> 32);
+		for (size_t i = static_cast<size_t>(hash) & mask; ; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+			if (slot.id == EMPTY) {
+				slot.tag = tag;
+				slot.id = newId;
+				return newId;
+			}
+			if (slot.tag == tag && memcmp(&vertices[slot.id], &vertex, sizeof(VertexType)) == 0) {
+				return slot.id;
+			}
+		}
+	}
+
+private:
+	struct Slot {
+		uint32_t tag;
+		uint32_t id;
+	};
+
+	std::vector<Slot> slots;
+	size_t mask;
+};
+
+// Below this many corners the sharded path costs more than it saves
+const size_t PARALLEL_WELD_THRESHOLD = 1 << 16;
+
+// The parallel path splits corners into shards by the top bits of their hash. The shard count is
+// fixed, so results do not depend on the thread count
+const uint32_t WELD_SHARD_BITS = 6;
+const uint32_t WELD_SHARD_COUNT = 1 << WELD_SHARD_BITS;
+
+// Collapses bitwise identical corners into unique vertices. Vertices are emitted in order of
+// first use and indices[i] refers to the vertex of corners[i]. With more than one thread, corners
+// are bucketed by hash into shards that are welded independently and then renumbered into
+// first-use order, which yields exactly the single-threaded result.
+template<typename VertexType>
+void weldVertices(const std::vector<VertexType>& corners, std::vector<VertexType>& vertices, std::vector<uint32_t>& indices,
+	unsigned threadCount = 1) {
+
+	vertices.clear();
+	indices.resize(corners.size());
+
+	threadCount = resolveThreadCount(threadCount);
+	if (threadCount == 1 || corners.size() < PARALLEL_WELD_THRESHOLD) {
+		VertexWeldTable<VertexType> table(corners.size());
+		vertices.reserve(corners.size());
+
+		for (size_t i = 0; i < corners.size(); i++) {
+			uint32_t id = table.findOrInsert(corners[i], hashVertexBytes(corners[i]), static_cast<uint32_t>(vertices.size()), vertices);
+			if (id == vertices.size()) {
+				vertices.push_back(corners[i]);
+			}
+			indices[i] = id;
+		}
+		return;
+	}
+
+	size_t rangeCount = threadCount;
+	size_t rangeSize = (corners.size() + rangeCount - 1) / rangeCount;
+
+	// Hash every corner and count how many land in each shard, per range of corners
+	std::vector<uint64_t> hashes(corners.size());
+	std::vector<uint32_t> shardCounts(rangeCount * WELD_SHARD_COUNT, 0);
+
+	runParallel(rangeCount, [&](size_t range) {
+		size_t begin = range * rangeSize;
+		size_t end = std::min(corners.size(), begin + rangeSize);
+		uint32_t* counts = &shardCounts[range * WELD_SHARD_COUNT];
+
+		for (size_t i = begin; i < end; i++) {
+			hashes[i] = hashVertexBytes(corners[i]);
+			counts[hashes[i] >> (64 - WELD_SHARD_BITS)]++;
+		}
+	});
+
+	// Scatter corner ids into per-shard lists, keeping each shard in corner order
+	std::vector<size_t> shardBegin(WELD_SHARD_COUNT + 1, 0);
+	std::vector<size_t> scatterOffsets(rangeCount * WELD_SHARD_COUNT);
+	size_t offset = 0;
+	for (uint32_t shard = 0; shard < WELD_SHARD_COUNT; shard++) {
+		shardBegin[shard] = offset;
+		for (size_t range = 0; range < rangeCount; range++) {
+			scatterOffsets[range * WELD_SHARD_COUNT + shard] = offset;
+			offset += shardCounts[range * WELD_SHARD_COUNT + shard];
+		}
+	}
+	shardBegin[WELD_SHARD_COUNT] = offset;
+
+	std::vector<uint32_t> shardCorners(corners.size());
+	runParallel(rangeCount, [&](size_t range) {
+		size_t begin = range * rangeSize;
+		size_t end = std::min(corners.size(), begin + rangeSize);
+		size_t* offsets = &scatterOffsets[range * WELD_SHARD_COUNT];
+
+		for (size_t i = begin; i < end; i++) {
+			shardCorners[offsets[hashes[i] >> (64 - WELD_SHARD_BITS)]++] = static_cast<uint32_t>(i);
+		}
+	});
+
+	// Weld every shard on its own. A corner's shard-local id is stored in indices for now
+	std::vector<std::vector<VertexType>> shardVertices(WELD_SHARD_COUNT);
+
+	runParallel(rangeCount, [&](size_t range) {
+		for (uint32_t shard = static_cast<uint32_t>(range); shard < WELD_SHARD_COUNT; shard += static_cast<uint32_t>(rangeCount)) {
+			size_t count = shardBegin[shard + 1] - shardBegin[shard];
+			std::vector<VertexType>& unique = shardVertices[shard];
+			unique.reserve(count);
+			VertexWeldTable<VertexType> table(count);
+
+			for (size_t j = shardBegin[shard]; j < shardBegin[shard + 1]; j++) {
+				uint32_t corner = shardCorners[j];
+				uint32_t id = table.findOrInsert(corners[corner], hashes[corner], static_cast<uint32_t>(unique.size()), unique);
+				if (id == unique.size()) {
+					unique.push_back(corners[corner]);
+				}
+				indices[corner] = id;
+			}
+		}
+	});
+
+	// Renumber into first-use order so the output matches the single-threaded path
+	std::vector<size_t> shardVertexBase(WELD_SHARD_COUNT + 1, 0);
+	for (uint32_t shard = 0; shard < WELD_SHARD_COUNT; shard++) {
+		shardVertexBase[shard + 1] = shardVertexBase[shard] + shardVertices[shard].size();
+	}
+
+	std::vector<uint32_t> finalIds(shardVertexBase[WELD_SHARD_COUNT], std::numeric_limits<uint32_t>::max());
+	vertices.reserve(finalIds.size());
+
+	for (size_t i = 0; i < corners.size(); i++) {
+		uint32_t shard = static_cast<uint32_t>(hashes[i] >> (64 - WELD_SHARD_BITS));
+		size_t shardId = shardVertexBase[shard] + indices[i];
+		if (finalIds[shardId] == std::numeric_limits<uint32_t>::max()) {
+			finalIds[shardId] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(shardVertices[shard][indices[i]]);
+		}
+		indices[i] = finalIds[shardId];
+	}
+}
@@ -6,9 +6,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -23,9 +20,29 @@
 #include <vector>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
 #include <array>
 #include <set>
-#include <unordered_map>
+#include <string>
+#include <memory>
+#include <sstream>
+#include <functional>
+
+#include "DeviceMemoryAllocator.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MipGenerator.h"
+#include "ObjParser.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "SceneBvh.h"
+#include "StartupGraph.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+#include "UploadBatch.h"
+#include "VertexLayout.h"
+#include "VertexWelder.h"
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
@@ -33,6 +50,40 @@ const int HEIGHT = 600;
 const std::string MODEL_PATH = "../models/chalet.obj";
 const std::string TEXTURE_PATH = "../textures/chalet.jpg";
 
+// Cooked copies of MODEL_PATH written after the first import, one per vertex layout and triangle
+// order: MODEL_PATH[.compact][.meshlets].meshcache
+const std::string MESH_CACHE_SUFFIX = ".meshcache";
+
+// Cooked copies of TEXTURE_PATH with their whole mip chain, written after the first decode, one
+// per texture format and mip filter: TEXTURE_PATH.<format>.<filter>.texcache
+const std::string TEXTURE_CACHE_SUFFIX = ".texcache";
+
+struct TextureFormatName {
+	const char* name;
+	VkFormat format;
+};
+
+// Texture formats selectable with --texture-format
+const TextureFormatName TEXTURE_FORMAT_NAMES[] = {
+	{ "rgba8", VK_FORMAT_R8G8B8A8_UNORM },
+	{ "bc1", VK_FORMAT_BC1_RGB_UNORM_BLOCK },
+	{ "bc3", VK_FORMAT_BC3_UNORM_BLOCK },
+	{ "bc7", VK_FORMAT_BC7_UNORM_BLOCK },
+	{ "etc2", VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK }
+};
+
+std::string getTextureFormatName(VkFormat format) {
+	for (const auto& entry : TEXTURE_FORMAT_NAMES) {
+		if (entry.format == format) {
+			return entry.name;
+		}
+	}
+	return "unknown";
+}
+
+// Driver pipeline cache saved on shutdown and reused by the next run on the same device and driver
+const std::string PIPELINE_CACHE_PATH = "pipeline.cache";
+
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_LUNARG_standard_validation"
 };
@@ -47,6 +98,123 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+// Device extensions that let the compute culling pass also write the draw count, in order of
+// preference, with their draw command
+struct DrawIndirectCountExtension {
+	const char* name;
+	const char* function;
+};
+
+const DrawIndirectCountExtension DRAW_INDIRECT_COUNT_EXTENSIONS[] = {
+	{ "VK_KHR_draw_indirect_count", "vkCmdDrawIndexedIndirectCountKHR" },
+	{ "VK_AMD_draw_indirect_count", "vkCmdDrawIndexedIndirectCountAMD" }
+};
+
+// Signature shared by the draw commands of DRAW_INDIRECT_COUNT_EXTENSIONS
+typedef void (VKAPI_PTR *DrawIndexedIndirectCountFunction)(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+	VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride);
+
+// Upper bound for ApplicationOptions::framesInFlight
+const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+enum class CameraPath {
+	// Looking at the scene from one corner
+	Fixed,
+	// Circling the scene while moving in and out and up and down
+	Orbit
+};
+
+struct ApplicationOptions {
+	// Render into app-owned images instead of a window and swap chain
+	bool headless = false;
+	uint32_t width = WIDTH;
+	uint32_t height = HEIGHT;
+
+	// Number of frames rendered before a headless run exits
+	uint32_t frameCount = 1000;
+
+	// Directory headless frames are read back into (as PPM files). Empty disables readback
+	std::string dumpDirectory;
+
+	// Read back every Nth frame. 0 reads back only the final frame
+	uint32_t dumpInterval = 0;
+
+	// Frames the CPU may record and submit ahead of the GPU (1 serializes CPU and GPU)
+	uint32_t framesInFlight = 2;
+
+	// Dump device memory allocator statistics once initialization is done
+	bool printMemoryStats = false;
+
+	// Print how long every startup phase took, on which thread
+	bool printStartupTiming = false;
+
+	// Worker threads used for asset loading. 0 uses every hardware thread
+	uint32_t loaderThreads = 0;
+
+	// Load the model from (and write) the cooked mesh cache instead of importing the OBJ every launch
+	bool useMeshCache = true;
+
+	// Load the texture and its mip chain from (and write) the cooked texture cache instead of decoding
+	// the image and blitting the mip chain every launch
+	bool useTextureCache = true;
+
+	// Preferred texture format, falling back to RGBA8 if the device cannot sample it. Undefined picks
+	// the best supported format that keeps alpha (BC7, then BC3). BC1 and ETC2 drop alpha
+	VkFormat textureFormat = VK_FORMAT_UNDEFINED;
+
+	// Filter of the CPU mip generator, which builds every cooked mip chain. Uncached RGBA8 chains
+	// are blitted on the GPU instead, except with a filter other than Box
+	MipFilter mipFilter = MipFilter::Box;
+
+	// Seed pipeline creation from (and save) PIPELINE_CACHE_PATH
+	bool usePipelineCache = true;
+
+	// Decode the texture, import the model and read the shaders on worker threads while the device
+	// objects are created
+	bool concurrentStartup = true;
+
+	// Draw with CompactVertex (quantized positions, half float texture coordinates) instead of Vertex
+	bool compactVertices = false;
+
+	// Draw calls the model's index range is split into, to stress command recording
+	uint32_t sceneDrawCount = 1;
+
+	// Threads recording the scene draws into secondary command buffers. 0 uses every hardware thread
+	uint32_t recordThreads = 0;
+
+	// Copies of the model drawn with one instanced draw, laid out on a square grid
+	uint32_t instanceCount = 1;
+
+	// Cull the instances against the view frustum in a compute pass that writes the draw commands
+	bool gpuCulling = false;
+
+	// Cull the instances against the view frustum on the CPU through a bounding volume hierarchy
+	bool cpuCulling = false;
+
+	// Draw every instance at the coarsest level of detail whose error stays within lodPixelError pixels
+	bool lod = false;
+	float lodPixelError = 1.0f;
+
+	// Cull the meshlets of every drawn instance against the view frustum and their normal cones on
+	// the CPU, and draw only the surviving index ranges. The mesh is imported in meshlet order for
+	// this and cached separately
+	bool clusterCulling = false;
+
+	// Time CPU zones and GPU passes and print per-zone statistics at exit
+	bool profile = false;
+
+	// Chrome trace JSON file every profiled zone is written to at exit. Implies profile
+	std::string profileTracePath;
+
+	// Milliseconds the animation advances per frame. 0 follows the wall clock
+	float fixedTimestep = 0.0f;
+
+	CameraPath cameraPath = CameraPath::Fixed;
+
+	// File the frame, CPU and GPU time of every frame are written to at exit
+	std::string frameTimesPath;
+};
+
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
 	auto func = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
 	if (func != nullptr) {
@@ -67,6 +235,9 @@ void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
+	// Queue family without graphics support that can run copies in parallel with rendering, or
+	// graphicsFamily when the device has none
+	int transferFamily = -1;
 
 	bool isComplete() {
 		return graphicsFamily >= 0 && presentFamily >= 0;
@@ -84,78 +255,220 @@ struct Vertex {
 	glm::vec3 color;
 	glm::vec2 texCoord;
 
-	static VkVertexInputBindingDescription getBindingDescription() {
-		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-		return bindingDescription;
+	bool operator==(const Vertex& other) const {
+		return pos == other.pos && color == other.color && texCoord == other.texCoord;
 	}
+};
 
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+typedef VertexLayout<Vertex,
+	VertexAttribute<0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)>,
+	VertexAttribute<1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)>,
+	VertexAttribute<2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord)>
+> FullVertexLayout;
+
+// 12 byte vertex for large meshes. Positions are quantized to the mesh bounds and dequantized in
+// the vertex shader, texture coordinates are half floats and the constant color is dropped
+struct CompactVertex {
+	uint16_t pos[4];
+	uint16_t texCoord[2];
+};
 
-		attributeDescriptions[2].binding = 0;
-		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+typedef VertexLayout<CompactVertex,
+	VertexAttribute<0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, pos)>,
+	VertexAttribute<2, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, texCoord)>
+> CompactVertexLayout;
 
-		return attributeDescriptions;
-	}
+// Per-instance vertex data, rewritten for every frame: the instance's model matrix, applied after
+// the shared UniformBufferObject::model, and a color multiplied into the texture (w unused)
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 tint;
+};
 
-	bool operator==(const Vertex& other) const {
-		return pos == other.pos && color == other.color && texCoord == other.texCoord;
+// The model matrix takes one location per column
+typedef VertexLayout<InstanceData,
+	VertexAttribute<3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, model)>,
+	VertexAttribute<4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, model) + 16>,
+	VertexAttribute<5, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, model) + 32>,
+	VertexAttribute<6, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, model) + 48>,
+	VertexAttribute<7, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, tint)>
+> InstanceLayout;
+
+// Distance between neighboring instances on the grid, in model units
+const float INSTANCE_SPACING = 2.5f;
+
+// The level of detail chain stops before a level would drop below this many triangles
+const uint32_t LOD_MIN_TRIANGLES = 64;
+
+// Output of a loader running on a worker thread, held back until the phase consuming its result
+// prints it, so its lines never interleave with those of the main thread
+struct DeferredLog {
+	std::ostringstream out;
+	std::ostringstream err;
+
+	void flush() {
+		std::cout << out.str() << std::flush;
+		std::cerr << err.str() << std::flush;
+		out.str("");
+		err.str("");
 	}
 };
 
-namespace std {
-	template<> struct hash<Vertex> {
-		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^
-				(hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
-		}
-	};
-}
+// CPU side of the texture, prepared on a worker thread: a complete mip chain from the texture
+// cache or built on the CPU, or only level 0 when the chain is blitted on the GPU
+struct TextureAsset {
+	TextureView view;
+	std::vector<unsigned char> storage;
+	bool blitMipChain = false;
+};
 
 struct UniformBufferObject {
 	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 proj;
+	// Dequantization of compact vertex positions (xyz, w unused)
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+// Inputs of the compute culling pass (Cull.comp), allocated from the ring after the scene UBO
+struct CullUniforms {
+	// UniformBufferObject::model, applied to the bounding sphere before the instance's model matrix
+	glm::mat4 model;
+	glm::vec4 frustumPlanes[6];
+	// Model space bounding sphere of the mesh (xyz center, w radius)
+	glm::vec4 boundingSphere;
+	uint32_t objectCount;
+	uint32_t indexCount;
+	// Whether survivors are packed at the front with the count in the header (used with a draw
+	// indirect count extension), or every object keeps its slot with an instance count of 0 or 1
+	uint32_t compact;
+	uint32_t lodCount;
+	// World space camera position (xyz) and the distance per unit of error at which a level of
+	// detail becomes acceptable (w, 0 draws full detail)
+	glm::vec4 cameraPosition;
+	// MeshView::lods as first index, index count and the error's bits
+	glm::uvec4 lods[MAX_MESH_LODS];
+};
+
+// Passes timed with GPU timestamps, each with a begin and an end query per frame in flight
+enum class GpuZone : uint32_t {
+	Cull,
+	RenderPass,
+	Count
+};
+
+const char* const GPU_ZONE_NAMES[] = { "GPU cull pass", "GPU render pass" };
+
+const uint32_t GPU_ZONE_COUNT = static_cast<uint32_t>(GpuZone::Count);
+
+// Work group size of Cull.comp
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// Each frame's region of the draw command buffer starts with the draw count, padded to this size,
+// followed by one VkDrawIndexedIndirectCommand per object
+const VkDeviceSize DRAW_COMMAND_HEADER_SIZE = 16;
+
+// Bytes of per-frame constant data each ring slice can hold
+const VkDeviceSize UNIFORM_RING_SLICE_SIZE = 64 * 1024;
+
+// The scene UBO is the first allocation of every slice, so every recording thread can bind it
+const VkDeviceSize SCENE_UNIFORM_OFFSET = 0;
+
+// A persistently mapped uniform buffer split into equally sized slices. Each slice belongs to one
+// frame in flight, and per-frame constant data is sub-allocated linearly from
+// the active slice. The data is bound via dynamic offsets, so a frame never maps/unmaps memory or
+// overwrites data that an earlier frame is still reading.
+struct UniformRing {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	Allocation memory;
+	uint8_t* mapped = nullptr;
+
+	VkDeviceSize alignment = 1;
+	VkDeviceSize sliceSize = 0;
+	uint32_t sliceCount = 0;
+
+	uint32_t activeSlice = 0;
+	VkDeviceSize head = 0;
+
+	VkDeviceSize sliceOffset(uint32_t slice) const {
+		return slice * sliceSize;
+	}
+
+	// Starts filling a slice again. The caller must know the GPU is done with it
+	void beginSlice(uint32_t slice) {
+		activeSlice = slice;
+		head = 0;
+	}
+
+	// Returns the offset of the allocation from the start of the active slice
+	VkDeviceSize allocate(VkDeviceSize size, void** data) {
+		VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+		if (offset + size > sliceSize) {
+			throw std::runtime_error("uniform ring slice overflow!");
+		}
+
+		head = offset + size;
+		*data = mapped + sliceOffset(activeSlice) + offset;
+		return offset;
+	}
+};
+
+// A range of the model's index buffer drawn with one vkCmdDrawIndexed, for a range of the frame's instances
+struct SceneDraw {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// Command buffers of one frame in flight, re-recorded every time the frame comes around. Every
+// recording thread has a pool of its own because pools must not be used by two threads at once,
+// and the pools are reset as a whole once the frame's fence signals instead of freeing buffers
+struct FrameCommands {
+	VkCommandPool primaryPool = VK_NULL_HANDLE;
+	VkCommandBuffer primary = VK_NULL_HANDLE;
+
+	// One pool and secondary command buffer per recording thread
+	std::vector<VkCommandPool> secondaryPools;
+	std::vector<VkCommandBuffer> secondaries;
 };
 
 class HelloTriangleApplication {
 public:
+	explicit HelloTriangleApplication(const ApplicationOptions& options = ApplicationOptions())
+		: options(options) {
+	}
+
 	void run() {
-		initWindow();
+		Profiler::setEnabled(options.profile);
+		Profiler::setCapturing(!options.profileTracePath.empty());
+
+		if (!options.headless) {
+			initWindow();
+		}
 		initVulkan();
 		mainLoop();
 		cleanup();
 	}
 
 private:
-	GLFWwindow* window;
+	ApplicationOptions options;
+
+	GLFWwindow* window = nullptr;
 
 	VkInstance instance;
 	VkDebugReportCallbackEXT callback;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device;
 
+	DeviceMemoryAllocator memoryAllocator;
+
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
 
 	VkSwapchainKHR swapChain;
 	std::vector<VkImage> swapChainImages;
@@ -164,41 +477,170 @@ private:
 	std::vector<VkImageView> swapChainImageViews;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 
+	// Backing memory of the offscreen color targets that stand in for swapChainImages in headless mode.
+	// There is one target per frame in flight, so the image index equals the frame index
+	std::vector<Allocation> offscreenImageMemory;
+
 	VkRenderPass renderPass;
 	VkDescriptorSetLayout descriptorSetLayout;
+
+	// Shared by every pipeline creation, VK_NULL_HANDLE with --no-pipeline-cache
+	PersistentPipelineCache pipelineCache;
+	std::vector<char> vertShaderCode;
+	std::vector<char> fragShaderCode;
+	std::vector<char> cullShaderCode;
+	uint32_t pipelineBuildCount = 0;
+
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
 
+	// Compute culling with --gpu-culling, one descriptor set per frame in flight
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	std::vector<VkDescriptorSet> cullDescriptorSets;
+	DrawIndexedIndirectCountFunction cmdDrawIndexedIndirectCount = nullptr;
+	bool multiDrawIndirect = false;
+
 	VkCommandPool commandPool;
+	VkCommandPool transferCommandPool;
+
+	// Asset uploads recorded during initialization, released once their fence signals
+	std::unique_ptr<UploadBatch> pendingUploads;
 
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	Allocation depthImageMemory;
 	VkImageView depthImageView;
 
 	uint32_t mipLevels;
+	VkFormat textureFormat;
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
+	Allocation textureImageMemory;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 
+	// Keeps a cached texture mapped until its upload has been staged
+	TextureCache textureCache;
+	TextureAsset textureAsset;
+	DeferredLog textureLog;
+
+	// Model space bounding sphere of the model (xyz center, w radius), around its bounding box
+	glm::vec4 meshBoundingSphere;
+
+	// Imported model data. Left empty when the model comes from the mesh cache
 	std::vector<Vertex> vertices;
+	std::vector<CompactVertex> compactVertices;
 	std::vector<uint32_t> indices;
+	std::vector<Meshlet> meshlets;
+	DeferredLog modelLog;
+
+	// The model's vertices and indices, pointing either at the vectors above or into meshCache
+	MeshCache meshCache;
+	MeshView mesh;
 
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	Allocation vertexBufferMemory;
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-
-	VkBuffer uniformBuffer;
-	VkDeviceMemory uniformBufferMemory;
+	Allocation indexBufferMemory;
+
+	UniformRing uniformRing;
+
+	// Persistently mapped InstanceData, one region of options.instanceCount entries per frame in flight
+	VkBuffer instanceBuffer;
+	Allocation instanceBufferMemory;
+	VkDeviceSize instanceRegionSize;
+
+	// Draw commands written by the culling pass, one region per frame in flight (see DRAW_COMMAND_HEADER_SIZE)
+	VkBuffer drawCommandBuffer = VK_NULL_HANDLE;
+	Allocation drawCommandBufferMemory;
+	VkDeviceSize drawCommandRegionSize = 0;
+
+	// Offset of the current frame's CullUniforms in its ring slice
+	VkDeviceSize cullUniformOffset = 0;
+
+	// Shared model matrix and view projection of the frame being prepared
+	glm::mat4 frameModel;
+	glm::mat4 frameViewProjection;
+
+	// CPU culling with --cpu-culling: every instance and its world bounds, of which only the visible
+	// ones are written to the instance buffer
+	SceneBvh sceneBvh;
+	std::vector<InstanceData> sceneInstances;
+	std::vector<Aabb> sceneBounds;
+	std::vector<uint32_t> visibleInstances;
+
+	// Camera position of the frame being prepared, and the distance from it at which an error of one
+	// model space unit projects to options.lodPixelError pixels
+	glm::vec3 frameCameraPosition;
+	float frameLodScale = 0.0f;
+
+	// Level of detail of every instance packed this frame, and the scene instance at every position
+	// of the instance buffer region
+	std::vector<uint32_t> instanceLods;
+	std::vector<uint32_t> packedInstances;
+
+	// Cluster culling totals since startup
+	double clusterCullMilliseconds = 0.0;
+	uint64_t clusterTestedTotal = 0;
+	uint64_t clusterOutsideTotal = 0;
+	uint64_t clusterBackfacingTotal = 0;
+
+	// Triangles and instances submitted per level of detail since startup. With GPU culling only the
+	// full detail upper bound of the triangles is known here and the instance totals stay 0
+	uint64_t submittedTriangleTotal = 0;
+	uint64_t lodInstanceTotals[MAX_MESH_LODS] = {};
+	uint32_t submittedFrameCount = 0;
+
+	// Culling totals since startup
+	double cullRefitMilliseconds = 0.0;
+	double cullTraversalMilliseconds = 0.0;
+	uint64_t cullVisibleTotal = 0;
+	uint64_t cullCulledTotal = 0;
+	uint64_t cullBoxesTestedTotal = 0;
+	uint32_t culledFrameCount = 0;
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSet descriptorSet;
 
-	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<FrameCommands> frameCommands;
+	std::unique_ptr<ThreadPool> recordPool;
+	// Index ranges every level of detail is split into, and the draws of the current frame
+	std::vector<SceneDraw> lodDrawRanges[MAX_MESH_LODS];
+	std::vector<SceneDraw> sceneDraws;
+
+	// Time spent recording command buffers since startup
+	double recordMilliseconds = 0.0;
+	uint32_t recordedFrameCount = 0;
+
+	// GPU timestamps of the GPU_ZONE_COUNT zones of every frame in flight, created when profiling
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	// Nanoseconds per timestamp tick, the mask of the valid bits and the CPU clock time of tick 0
+	double timestampPeriod = 1.0;
+	uint64_t timestampMask = 0;
+	int64_t timestampOffset = 0;
+	// Whether a frame's queries were written by its last submission and not collected yet, and the
+	// frameNumber of that submission
+	bool timestampsPending[MAX_FRAMES_IN_FLIGHT] = {};
+	uint64_t timestampFrameNumbers[MAX_FRAMES_IN_FLIGHT] = {};
+
+	// Frames started since startup
+	uint64_t frameNumber = 0;
+
+	// Per frame timings with --frame-times. CPU time is the frame's work after its fence wait, GPU
+	// time spans its timestamped passes (negative without timestamps)
+	struct FrameTiming {
+		uint64_t start;
+		double cpuMilliseconds;
+		double gpuMilliseconds;
+	};
+	std::vector<FrameTiming> frameTimings;
 
-	VkSemaphore imageAvailableSemaphore;
-	VkSemaphore renderFinishedSemaphore;
+	std::vector<VkSemaphore> imageAvailableSemaphores;
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	std::vector<VkFence> inFlightFences;
+	// Fence of the frame currently using each swap chain image, or VK_NULL_HANDLE
+	std::vector<VkFence> imagesInFlight;
+	uint32_t currentFrame = 0;
 
 	void initWindow() {
 		glfwInit();
@@ -209,102 +651,299 @@ private:
 	}
 
 	void initVulkan() {
-		createInstance();
-		setupDebugCallback();
-		createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-		createSwapChain();
-		createImageViews();
-		createRenderPass();
-		createDescriptorSetLayout();
-		createGraphicsPipeline();
-		createCommandPool();
-		createDepthResources();
-		createFramebuffers();
-		createTextureImage();
-		createTextureImageView();
-		createTextureSampler();
-		loadModel();
-		createVertexBuffer();
-		createIndexBuffer();
-		createUniformBuffer();
-		createDescriptorPool();
-		createDescriptorSet();
-		createCommandBuffers();
-		createSemaphores();
+		PROFILE_ZONE("initVulkan");
+
+		// Vulkan objects are created in the order below on this thread. The asset loads and shader
+		// reads only depend on the options (the texture load also on the chosen format), so they run
+		// on workers until the phases that upload or use them
+		StartupGraph startup;
+		auto ordered = [&](const char* name, std::initializer_list<StartupGraph::PhaseId> dependencies, void (HelloTriangleApplication::*create)()) {
+			return startup.addOrderedPhase(name, dependencies, std::bind(create, this));
+		};
+		auto parallel = [&](const char* name, std::initializer_list<StartupGraph::PhaseId> dependencies, void (HelloTriangleApplication::*load)()) {
+			return startup.addParallelPhase(name, dependencies, std::bind(load, this));
+		};
+
+		auto modelLoadPhase = parallel("loadModel", {}, &HelloTriangleApplication::loadModel);
+		auto shaderLoadPhase = parallel("loadShaders", {}, &HelloTriangleApplication::loadShaders);
+
+		auto instancePhase = ordered("createInstance", {}, &HelloTriangleApplication::createInstance);
+		ordered("setupDebugCallback", { instancePhase }, &HelloTriangleApplication::setupDebugCallback);
+		auto surfacePhase = ordered("createSurface", { instancePhase }, &HelloTriangleApplication::createSurface);
+		auto physicalDevicePhase = ordered("pickPhysicalDevice", { surfacePhase }, &HelloTriangleApplication::pickPhysicalDevice);
+		auto formatPhase = startup.addOrderedPhase("chooseTextureFormat", { physicalDevicePhase }, [this]() {
+			textureFormat = chooseTextureFormat();
+		});
+		auto textureLoadPhase = parallel("loadTexture", { formatPhase }, &HelloTriangleApplication::loadTexture);
+
+		auto logicalDevicePhase = ordered("createLogicalDevice", { physicalDevicePhase }, &HelloTriangleApplication::createLogicalDevice);
+		auto allocatorPhase = startup.addOrderedPhase("initAllocator", { logicalDevicePhase }, [this]() {
+			memoryAllocator.init(physicalDevice, device);
+		});
+		auto pipelineCachePhase = ordered("createPipelineCache", { logicalDevicePhase }, &HelloTriangleApplication::createPipelineCache);
+		auto swapChainPhase = ordered("createSwapChain", { logicalDevicePhase }, &HelloTriangleApplication::createSwapChain);
+		auto imageViewsPhase = ordered("createImageViews", { swapChainPhase }, &HelloTriangleApplication::createImageViews);
+		auto renderPassPhase = ordered("createRenderPass", { swapChainPhase }, &HelloTriangleApplication::createRenderPass);
+		auto descriptorSetLayoutPhase = ordered("createDescriptorSetLayout", { logicalDevicePhase }, &HelloTriangleApplication::createDescriptorSetLayout);
+		ordered("createGraphicsPipeline", { renderPassPhase, descriptorSetLayoutPhase, pipelineCachePhase, shaderLoadPhase },
+			&HelloTriangleApplication::createGraphicsPipeline);
+		ordered("createCullPipeline", { pipelineCachePhase, shaderLoadPhase }, &HelloTriangleApplication::createCullPipeline);
+		auto commandPoolPhase = ordered("createCommandPool", { logicalDevicePhase }, &HelloTriangleApplication::createCommandPool);
+		ordered("createTimestampQueries", { commandPoolPhase }, &HelloTriangleApplication::createTimestampQueries);
+		auto depthResourcesPhase = ordered("createDepthResources", { swapChainPhase, allocatorPhase, commandPoolPhase }, &HelloTriangleApplication::createDepthResources);
+		ordered("createFramebuffers", { imageViewsPhase, renderPassPhase, depthResourcesPhase }, &HelloTriangleApplication::createFramebuffers);
+
+		auto uploadsPhase = ordered("beginUploads", { allocatorPhase, commandPoolPhase }, &HelloTriangleApplication::beginUploads);
+		auto textureImagePhase = ordered("createTextureImage", { uploadsPhase, textureLoadPhase }, &HelloTriangleApplication::createTextureImage);
+		auto textureImageViewPhase = ordered("createTextureImageView", { textureImagePhase }, &HelloTriangleApplication::createTextureImageView);
+		auto textureSamplerPhase = ordered("createTextureSampler", { textureImagePhase }, &HelloTriangleApplication::createTextureSampler);
+		auto vertexBufferPhase = ordered("createVertexBuffer", { uploadsPhase, modelLoadPhase }, &HelloTriangleApplication::createVertexBuffer);
+		auto indexBufferPhase = ordered("createIndexBuffer", { uploadsPhase, modelLoadPhase }, &HelloTriangleApplication::createIndexBuffer);
+		ordered("submitUploads", { textureImagePhase, vertexBufferPhase, indexBufferPhase }, &HelloTriangleApplication::submitUploads);
+
+		auto sceneDrawsPhase = ordered("createSceneDraws", { modelLoadPhase }, &HelloTriangleApplication::createSceneDraws);
+		auto uniformBufferPhase = ordered("createUniformBuffer", { allocatorPhase }, &HelloTriangleApplication::createUniformBuffer);
+		auto instanceBufferPhase = ordered("createInstanceBuffer", { allocatorPhase }, &HelloTriangleApplication::createInstanceBuffer);
+		auto drawCommandBufferPhase = ordered("createDrawCommandBuffer", { allocatorPhase, sceneDrawsPhase }, &HelloTriangleApplication::createDrawCommandBuffer);
+		auto descriptorPoolPhase = ordered("createDescriptorPool", { logicalDevicePhase }, &HelloTriangleApplication::createDescriptorPool);
+		ordered("createDescriptorSet", { descriptorPoolPhase, descriptorSetLayoutPhase, uniformBufferPhase, instanceBufferPhase,
+			drawCommandBufferPhase, textureImageViewPhase, textureSamplerPhase }, &HelloTriangleApplication::createDescriptorSet);
+		ordered("createFrameCommands", { commandPoolPhase, sceneDrawsPhase }, &HelloTriangleApplication::createFrameCommands);
+		ordered("createSyncObjects", { logicalDevicePhase }, &HelloTriangleApplication::createSyncObjects);
+
+		// One thread per parallel phase besides this one. With --serial-startup the pool is just this
+		// thread, which then runs every phase in the order above
+		ThreadPool startupPool(options.concurrentStartup ? 4 : 1);
+		startup.run(startupPool);
+
+		std::cout << "startup: initVulkan took " << startup.getMilliseconds()
+			<< " ms with assets loaded " << (options.concurrentStartup ? "concurrently" : "serially") << std::endl;
+
+		if (options.printStartupTiming) {
+			startup.printTimings(std::cout);
+		}
+
+		if (options.printMemoryStats) {
+			memoryAllocator.printStats(std::cout);
+		}
 	}
 
 	void mainLoop() {
-		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		if (options.headless) {
+			headlessLoop();
+		}
+		else {
+			while (!glfwWindowShouldClose(window)) {
+				glfwPollEvents();
+
+				drawFrame();
+			}
+
+			vkDeviceWaitIdle(device);
+		}
+		uint64_t idleTime = Profiler::now();
+
+		if (recordedFrameCount > 0) {
+			std::cout << "recording: " << (recordMilliseconds / recordedFrameCount) << " ms/frame for " << sceneDraws.size() << " draw(s) on "
+				<< std::min<size_t>(recordPool->getThreadCount(), sceneDraws.size()) << " thread(s)" << std::endl;
+		}
+
+		if (culledFrameCount > 0) {
+			std::cout << "culling: " << (cullVisibleTotal / culledFrameCount) << " visible, " << (cullCulledTotal / culledFrameCount) << " culled of "
+				<< options.instanceCount << " instances per frame in " << ((cullRefitMilliseconds + cullTraversalMilliseconds) / culledFrameCount)
+				<< " ms/frame (refit " << (cullRefitMilliseconds / culledFrameCount) << " ms, traversal " << (cullTraversalMilliseconds / culledFrameCount)
+				<< " ms, " << (cullBoxesTestedTotal / culledFrameCount) << " boxes tested over " << sceneBvh.getNodeCount() << " nodes)" << std::endl;
+		}
+
+		if (clusterTestedTotal > 0) {
+			std::cout << "clusters: " << (100.0 * (clusterOutsideTotal + clusterBackfacingTotal) / clusterTestedTotal) << "% culled ("
+				<< (100.0 * clusterOutsideTotal / clusterTestedTotal) << "% outside the frustum, " << (100.0 * clusterBackfacingTotal / clusterTestedTotal)
+				<< "% backfacing) of " << (clusterTestedTotal / submittedFrameCount) << " tested per frame in "
+				<< (clusterCullMilliseconds / submittedFrameCount) << " ms/frame" << std::endl;
+		}
 
-			updateUniformBuffer();
-			drawFrame();
+		// The device is idle, so the frames still in flight have finished
+		for (uint32_t frame = 0; frame < options.framesInFlight; frame++) {
+			collectGpuZones(frame);
+		}
+
+		if (Profiler::isEnabled()) {
+			printProfile();
+		}
+
+		if (!options.frameTimesPath.empty()) {
+			writeFrameTimes(idleTime);
+		}
+
+		if (submittedFrameCount > 0 && options.gpuCulling) {
+			std::cout << "submitted: at most " << (submittedTriangleTotal / submittedFrameCount) << " triangles/frame, culled and with level of detail "
+				<< (options.lod ? "picked" : "off") << " on the GPU" << std::endl;
+		}
+		else if (submittedFrameCount > 0) {
+			std::cout << "submitted: " << (submittedTriangleTotal / submittedFrameCount) << " triangles/frame with level of detail "
+				<< (options.lod ? "on" : "off") << ", instances per level";
+			for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+				std::cout << (lod == 0 ? " " : "/") << (lodInstanceTotals[lod] / submittedFrameCount);
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	// Writes one line of frame, CPU and GPU milliseconds per frame. A frame's time runs until the next
+	// frame starts, or for the last one until the device went idle at idleTime
+	void writeFrameTimes(uint64_t idleTime) {
+		std::ofstream file(options.frameTimesPath);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open frame times file " + options.frameTimesPath + "!");
+		}
+
+		file << "# frame_ms cpu_ms gpu_ms" << std::endl;
+		for (size_t i = 0; i < frameTimings.size(); i++) {
+			uint64_t next = i + 1 < frameTimings.size() ? frameTimings[i + 1].start : idleTime;
+			file << (next - frameTimings[i].start) / 1e6 << " " << frameTimings[i].cpuMilliseconds << " " << frameTimings[i].gpuMilliseconds << "\n";
+		}
+	}
+
+	// Prints the profiler statistics, and writes the trace when one was asked for
+	void printProfile() {
+		Profiler::collect();
+		Profiler::printStatistics(std::cout);
+
+		if (!options.profileTracePath.empty()) {
+			if (Profiler::writeChromeTrace(options.profileTracePath)) {
+				std::cout << "profile: trace written to " << options.profileTracePath << std::endl;
+			}
+			else {
+				std::cerr << "profile: failed to write trace " << options.profileTracePath << std::endl;
+			}
+		}
+	}
+
+	void headlessLoop() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		for (uint32_t frame = 0; frame < options.frameCount; frame++) {
+			uint32_t imageIndex = drawHeadlessFrame();
+
+			bool lastFrame = frame + 1 == options.frameCount;
+			bool dumpThisFrame = options.dumpInterval > 0 ? (frame % options.dumpInterval == 0) : lastFrame;
+			if (!options.dumpDirectory.empty() && dumpThisFrame) {
+				saveOffscreenImage(imageIndex, options.dumpDirectory + "/frame_" + std::to_string(frame) + ".ppm");
+			}
 		}
 
 		vkDeviceWaitIdle(device);
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double, std::chrono::seconds::period>(endTime - startTime).count();
+
+		std::cout << "headless: " << options.frameCount << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+			<< " with " << options.framesInFlight << " frame(s) in flight in " << seconds << " s (" << (seconds * 1000.0 / options.frameCount) << " ms/frame, "
+			<< (options.frameCount / seconds) << " fps)" << std::endl;
 	}
 
 	void cleanupSwapChain() {
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		memoryAllocator.free(depthImageMemory);
 
 		for (auto framebuffer : swapChainFramebuffers) {
 			vkDestroyFramebuffer(device, framebuffer, nullptr);
 		}
 
-		vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyRenderPass(device, renderPass, nullptr);
-
 		for (auto imageView : swapChainImageViews) {
 			vkDestroyImageView(device, imageView, nullptr);
 		}
 
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
+		if (options.headless) {
+			for (size_t i = 0; i < swapChainImages.size(); i++) {
+				vkDestroyImage(device, swapChainImages[i], nullptr);
+				memoryAllocator.free(offscreenImageMemory[i]);
+			}
+			offscreenImageMemory.clear();
+		}
+		else {
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		}
+	}
+
+	void cleanupRenderPass() {
+		vkDestroyPipeline(device, graphicsPipeline, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+		vkDestroyRenderPass(device, renderPass, nullptr);
 	}
 
 	void cleanup() {
 		cleanupSwapChain();
+		cleanupRenderPass();
 
 		vkDestroySampler(device, textureSampler, nullptr);
 		vkDestroyImageView(device, textureImageView, nullptr);
 		vkDestroyImage(device, textureImage, nullptr);
-		vkFreeMemory(device, textureImageMemory, nullptr);
+		memoryAllocator.free(textureImageMemory);
 
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-		vkDestroyBuffer(device, uniformBuffer, nullptr);
-		vkFreeMemory(device, uniformBufferMemory, nullptr);
+		destroyUniformBuffer();
+
+		vkDestroyBuffer(device, instanceBuffer, nullptr);
+		memoryAllocator.free(instanceBufferMemory);
+
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+		}
+
+		if (options.gpuCulling) {
+			vkDestroyBuffer(device, drawCommandBuffer, nullptr);
+			memoryAllocator.free(drawCommandBufferMemory);
+
+			vkDestroyPipeline(device, cullPipeline, nullptr);
+			vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr);
+		}
 
 		vkDestroyBuffer(device, indexBuffer, nullptr);
-		vkFreeMemory(device, indexBufferMemory, nullptr);
+		memoryAllocator.free(indexBufferMemory);
 
 		vkDestroyBuffer(device, vertexBuffer, nullptr);
-		vkFreeMemory(device, vertexBufferMemory, nullptr);
+		memoryAllocator.free(vertexBufferMemory);
 
-		vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-		vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+		for (size_t i = 0; i < inFlightFences.size(); i++) {
+			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+			vkDestroyFence(device, inFlightFences[i], nullptr);
+		}
+
+		pendingUploads.reset();
 
+		destroyFrameCommands();
+		vkDestroyCommandPool(device, transferCommandPool, nullptr);
 		vkDestroyCommandPool(device, commandPool, nullptr);
 
+		memoryAllocator.destroy();
+
+		if (options.usePipelineCache && !pipelineCache.save()) {
+			std::cerr << "pipeline cache: failed to write " << PIPELINE_CACHE_PATH << std::endl;
+		}
+		pipelineCache.destroy();
+
 		vkDestroyDevice(device, nullptr);
 
 		if (enableValidationLayers) {
 			DestroyDebugReportCallbackEXT(instance, callback, nullptr);
 		}
 
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (surface != VK_NULL_HANDLE) {
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
 		vkDestroyInstance(instance, nullptr);
 
-		glfwDestroyWindow(window);
+		if (window != nullptr) {
+			glfwDestroyWindow(window);
 
-		glfwTerminate();
+			glfwTerminate();
+		}
 	}
 
 	void recreateSwapChain() {
@@ -314,15 +953,23 @@ private:
 
 		vkDeviceWaitIdle(device);
 
+		VkFormat previousFormat = swapChainImageFormat;
 		cleanupSwapChain();
 
 		createSwapChain();
 		createImageViews();
-		createRenderPass();
-		createGraphicsPipeline();
+
+		// The render pass and the pipeline built against it only depend on the attachment formats
+		if (swapChainImageFormat != previousFormat) {
+			cleanupRenderPass();
+			createRenderPass();
+			createGraphicsPipeline();
+		}
+
 		createDepthResources();
 		createFramebuffers();
-		createCommandBuffers();
+
+		imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 	}
 
 	void createInstance() {
@@ -373,6 +1020,8 @@ private:
 	}
 
 	void createSurface() {
+		if (options.headless) return;
+
 		if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create window surface!");
 		}
@@ -405,7 +1054,7 @@ private:
 		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+		std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.transferFamily };
 
 		float queuePriority = 1.0f;
 		for (int queueFamily : uniqueQueueFamilies) {
@@ -417,8 +1066,16 @@ private:
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+		deviceFeatures.textureCompressionETC2 = supportedFeatures.textureCompressionETC2;
+
+		auto extensions = getRequiredDeviceExtensions();
+		const DrawIndirectCountExtension* drawIndirectCount = prepareGpuCulling(supportedFeatures, deviceFeatures, extensions);
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -428,8 +1085,8 @@ private:
 
 		createInfo.pEnabledFeatures = &deviceFeatures;
 
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		if (enableValidationLayers) {
 			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -445,9 +1102,70 @@ private:
 
 		vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+		vkGetDeviceQueue(device, indices.transferFamily, 0, &transferQueue);
+
+		if (drawIndirectCount != nullptr) {
+			cmdDrawIndexedIndirectCount = (DrawIndexedIndirectCountFunction)vkGetDeviceProcAddr(device, drawIndirectCount->function);
+		}
+
+		if (options.gpuCulling) {
+			std::cout << "culling: on the GPU, drawn with "
+				<< (cmdDrawIndexedIndirectCount != nullptr ? std::string("a draw count from ") + drawIndirectCount->name :
+					multiDrawIndirect ? "one multi-draw per frame" : "one indirect draw per instance") << std::endl;
+		}
+	}
+
+	// Turns --gpu-culling off on devices that cannot draw the instances the compute pass selects.
+	// Otherwise enables the features it relies on and returns the draw count extension to enable, if any
+	const DrawIndirectCountExtension* prepareGpuCulling(const VkPhysicalDeviceFeatures& supportedFeatures, VkPhysicalDeviceFeatures& deviceFeatures,
+		std::vector<const char*>& extensions) {
+		if (!options.gpuCulling) {
+			return nullptr;
+		}
+
+		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		// The draw commands select their instance through firstInstance
+		if (!supportedFeatures.drawIndirectFirstInstance || !(queueFamilies[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+			std::cout << "culling: the device cannot cull on the GPU, drawing every instance" << std::endl;
+			options.gpuCulling = false;
+			return nullptr;
+		}
+
+		deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+		multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& candidate : DRAW_INDIRECT_COUNT_EXTENSIONS) {
+			for (const auto& extension : availableExtensions) {
+				if (strcmp(extension.extensionName, candidate.name) == 0) {
+					extensions.push_back(candidate.name);
+					return &candidate;
+				}
+			}
+		}
+
+		return nullptr;
 	}
 
 	void createSwapChain() {
+		if (options.headless) {
+			createOffscreenImages();
+			return;
+		}
+
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
 		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -499,6 +1217,20 @@ private:
 		swapChainExtent = extent;
 	}
 
+	void createOffscreenImages() {
+		swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		swapChainExtent = { options.width, options.height };
+
+		swapChainImages.resize(options.framesInFlight);
+		offscreenImageMemory.resize(options.framesInFlight);
+
+		for (uint32_t i = 0; i < options.framesInFlight; i++) {
+			createImage(swapChainExtent.width, swapChainExtent.height, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImageMemory[i]);
+		}
+	}
+
 	void createImageViews() {
 		swapChainImageViews.resize(swapChainImages.size());
 
@@ -516,7 +1248,8 @@ private:
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// Offscreen targets are left ready for readback instead of presentation
+		colorAttachment.finalLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 		VkAttachmentDescription depthAttachment = {};
 		depthAttachment.format = findDepthFormat();
@@ -550,7 +1283,17 @@ private:
 		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+		// Make the color writes visible to the readback copy that follows in headless mode
+		VkSubpassDependency readbackDependency = {};
+		readbackDependency.srcSubpass = 0;
+		readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
 		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+		std::array<VkSubpassDependency, 2> dependencies = { dependency, readbackDependency };
 
 		VkRenderPassCreateInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -558,8 +1301,8 @@ private:
 		renderPassInfo.pAttachments = attachments.data();
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		renderPassInfo.dependencyCount = options.headless ? 2 : 1;
+		renderPassInfo.pDependencies = dependencies.data();
 
 		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass!");
@@ -570,7 +1313,7 @@ private:
 		VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 		uboLayoutBinding.binding = 0;
 		uboLayoutBinding.descriptorCount = 1;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.pImmutableSamplers = nullptr;
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -593,9 +1336,34 @@ private:
 		}
 	}
 
+	void createPipelineCache() {
+		if (!options.usePipelineCache) {
+			return;
+		}
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		pipelineCache.create(device, properties, PIPELINE_CACHE_PATH);
+
+		if (pipelineCache.getLoadedSize() > 0) {
+			std::cout << "pipeline cache: loaded " << pipelineCache.getLoadedSize() << " bytes from " << PIPELINE_CACHE_PATH << std::endl;
+		}
+		else {
+			std::cout << "pipeline cache: starting empty, no usable " << PIPELINE_CACHE_PATH << " for this device and driver" << std::endl;
+		}
+	}
+
+	// Worker side of pipeline creation: reads the SPIR-V, which is kept for swap chain recreation
+	void loadShaders() {
+		vertShaderCode = readFile(options.compactVertices ? "../Shaders/compact_vert.spv" : "../Shaders/vert.spv");
+		fragShaderCode = readFile("../Shaders/frag.spv");
+		if (options.gpuCulling) {
+			cullShaderCode = readFile("../Shaders/cull_comp.spv");
+		}
+	}
+
 	void createGraphicsPipeline() {
-		auto vertShaderCode = readFile("../Shaders/vert.spv");
-		auto fragShaderCode = readFile("../Shaders/frag.spv");
+		auto startTime = std::chrono::high_resolution_clock::now();
 
 		VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 		VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -617,12 +1385,19 @@ private:
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+		// Binding 0 streams the model's vertices, binding 1 the per-instance data
+		std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {{
+			options.compactVertices ? CompactVertexLayout::getBindingDescription() : FullVertexLayout::getBindingDescription(),
+			InstanceLayout::getBindingDescription(1, VK_VERTEX_INPUT_RATE_INSTANCE)
+		}};
+
+		auto attributeDescriptions = getVertexLayout().attributes;
+		auto instanceAttributeDescriptions = InstanceLayout::getAttributeDescriptions(1);
+		attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
 
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -630,24 +1405,18 @@ private:
 		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)swapChainExtent.width;
-		viewport.height = (float)swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-
+		// Viewport and scissor are set while recording, so the pipeline survives swap chain resizes
 		VkPipelineViewportStateCreateInfo viewportState = {};
 		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
+
+		std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
 
 		VkPipelineRasterizationStateCreateInfo rasterizer = {};
 		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -707,6 +1476,7 @@ private:
 		pipelineInfo.pVertexInputState = &vertexInputInfo;
 		pipelineInfo.pInputAssemblyState = &inputAssembly;
 		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pDynamicState = &dynamicState;
 		pipelineInfo.pRasterizationState = &rasterizer;
 		pipelineInfo.pMultisampleState = &multisampling;
 		pipelineInfo.pColorBlendState = &colorBlending;
@@ -716,15 +1486,75 @@ private:
 		pipelineInfo.subpass = 0;
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+		if (vkCreateGraphicsPipelines(device, pipelineCache.get(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
 
 		vkDestroyShaderModule(device, fragShaderModule, nullptr);
 		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		std::cout << "pipeline: created in " << std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count()
+			<< " ms " << (pipelineBuildCount == 0 ? "at startup" : "on swap chain recreation")
+			<< (options.usePipelineCache ? "" : " without pipeline cache") << std::endl;
+		pipelineBuildCount++;
 	}
 
-	void createFramebuffers() {
+	void createCullPipeline() {
+		if (!options.gpuCulling) {
+			return;
+		}
+
+		std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorCount = 1;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		// The frame's instance data and draw commands
+		for (uint32_t i = 1; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorCount = 1;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullDescriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling descriptor set layout!");
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling pipeline layout!");
+		}
+
+		VkShaderModule shaderModule = createShaderModule(cullShaderCode);
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = cullPipelineLayout;
+
+		if (vkCreateComputePipelines(device, pipelineCache.get(), 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling pipeline!");
+		}
+
+		vkDestroyShaderModule(device, shaderModule, nullptr);
+	}
+
+	void createFramebuffers() {
 		swapChainFramebuffers.resize(swapChainImageViews.size());
 
 		for (size_t i = 0; i < swapChainImageViews.size(); i++) {
@@ -758,6 +1588,36 @@ private:
 		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics command pool!");
 		}
+
+		VkCommandPoolCreateInfo transferPoolInfo = {};
+		transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		transferPoolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+
+		if (vkCreateCommandPool(device, &transferPoolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create transfer command pool!");
+		}
+	}
+
+	void beginUploads() {
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+		UploadQueue transfer = { transferQueue, static_cast<uint32_t>(queueFamilyIndices.transferFamily), transferCommandPool };
+		UploadQueue graphics = { graphicsQueue, static_cast<uint32_t>(queueFamilyIndices.graphicsFamily), commandPool };
+
+		pendingUploads.reset(new UploadBatch(device, memoryAllocator, transfer, graphics));
+	}
+
+	// Submits the recorded uploads without waiting. Frames submitted to the graphics queue afterwards
+	// are ordered behind them, so the staging memory is only reclaimed by collectUploads
+	void submitUploads() {
+		pendingUploads->submit();
+	}
+
+	void collectUploads() {
+		if (pendingUploads && pendingUploads->poll()) {
+			pendingUploads.reset();
+		}
 	}
 
 	void createDepthResources() {
@@ -795,7 +1655,46 @@ private:
 		throw std::runtime_error("failed to find supported format!");
 	}
 
-	void createTextureImage() {
+	VkFormat chooseTextureFormat() {
+		std::vector<VkFormat> candidates;
+		if (options.textureFormat != VK_FORMAT_UNDEFINED) {
+			candidates.push_back(options.textureFormat);
+		}
+		else {
+			candidates.push_back(VK_FORMAT_BC7_UNORM_BLOCK);
+			candidates.push_back(VK_FORMAT_BC3_UNORM_BLOCK);
+		}
+
+		// Always supported, so the search cannot fail
+		candidates.push_back(VK_FORMAT_R8G8B8A8_UNORM);
+
+		return findSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+	}
+
+	// Worker side of the texture load: maps the cooked mip chain, or decodes the image and builds
+	// (and cooks) the chain on the CPU. Only reads options and textureFormat and only writes
+	// textureAsset and textureCache, so it can overlap device creation
+	void loadTexture() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::string cachePath = TEXTURE_PATH + "." + getTextureFormatName(textureFormat) +
+			(options.mipFilter == MipFilter::Kaiser ? ".kaiser" : ".box") + TEXTURE_CACHE_SUFFIX;
+
+		bool cached = options.useTextureCache && textureCache.open(cachePath, TEXTURE_PATH, textureFormat);
+		if (cached) {
+			textureAsset.view = textureCache.getView();
+		}
+		else {
+			decodeTexture(cachePath);
+		}
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		textureLog.out << "texture: " << (cached ? "loaded from " + cachePath : "decoded " + TEXTURE_PATH) << " in "
+			<< std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count() << " ms" << std::endl;
+	}
+
+	void decodeTexture(const std::string& cachePath) {
 		int texWidth, texHeight, texChannels;
 		stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 		VkDeviceSize imageSize = texWidth * texHeight * 4;
@@ -804,36 +1703,140 @@ private:
 			throw std::runtime_error("failed to load texture image!");
 		}
 
-		mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+		TextureView& texture = textureAsset.view;
+		texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+		texture.width = static_cast<uint32_t>(texWidth);
+		texture.height = static_cast<uint32_t>(texHeight);
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		// Without the cache an uncompressed chain can be blitted on the GPU, which vkCmdBlitImage with
+		// VK_FILTER_LINEAR allows because chooseTextureFormat only picks linearly filterable formats.
+		// A blit only averages 2x2 texels, so any other mip filter takes the CPU generator
+		if (!options.useTextureCache && textureFormat == VK_FORMAT_R8G8B8A8_UNORM && options.mipFilter == MipFilter::Box) {
+			// Only level 0 is uploaded, createTextureImage blits the rest of the chain
+			textureAsset.storage.assign(pixels, pixels + imageSize);
+			stbi_image_free(pixels);
 
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(device, stagingBufferMemory);
+			texture.levels = { { texture.width, texture.height, 0, imageSize } };
+			texture.data = textureAsset.storage.data();
+			texture.dataSize = imageSize;
+			textureAsset.blitMipChain = true;
+			return;
+		}
+
+		// Build the mip chain on the CPU so it can be compressed and cooked
+		bool dropsAlpha = textureFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK || textureFormat == VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+		if (dropsAlpha && !isOpaque(pixels, static_cast<size_t>(texWidth) * texHeight)) {
+			textureLog.err << "texture: " << getTextureFormatName(textureFormat) << " drops the alpha channel of " << TEXTURE_PATH << std::endl;
+		}
 
+		std::vector<unsigned char>& chain = textureAsset.storage;
+		chain.resize(static_cast<size_t>(layoutMipChain(texture.width, texture.height, texture.format, texture.levels)));
+		memcpy(chain.data(), pixels, static_cast<size_t>(imageSize));
 		stbi_image_free(pixels);
 
-		createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, 
+		// The texture is sRGB encoded, so the chain is filtered in linear space
+		MipGenerationOptions mipOptions;
+		mipOptions.filter = options.mipFilter;
+		mipOptions.srgb = true;
+		mipOptions.threadCount = options.loaderThreads;
+		generateMipChain(chain.data(), texture.levels, mipOptions);
+		texture.data = chain.data();
+		texture.dataSize = chain.size();
+
+		if (textureFormat != VK_FORMAT_R8G8B8A8_UNORM) {
+			std::vector<unsigned char> compressed;
+			TextureView compressedTexture;
+			compressTexture(texture, textureFormat, compressed, compressedTexture, options.loaderThreads);
+			chain.swap(compressed);
+			texture = compressedTexture;
+		}
+
+		if (options.useTextureCache && !TextureCache::write(cachePath, TEXTURE_PATH, texture)) {
+			textureLog.err << "texture: failed to write texture cache " << cachePath << std::endl;
+		}
+	}
+
+	// Records the upload of the texture loaded by loadTexture into the pending upload batch
+	void createTextureImage() {
+		textureLog.flush();
+
+		if (textureAsset.blitMipChain) {
+			uploadTextureForBlit(textureAsset.view);
+		}
+		else {
+			uploadTexture(textureAsset.view);
+		}
+
+		// The staging buffer holds a copy, so the decoded image or cache mapping can go
+		textureAsset = TextureAsset();
+		textureCache.close();
+	}
+
+	void uploadTextureForBlit(const TextureView& texture) {
+		mipLevels = getMipLevelCount(texture.width, texture.height);
+
+		StagingRegion staging = pendingUploads->allocateStaging(texture.dataSize);
+		memcpy(staging.mapped, texture.data, static_cast<size_t>(texture.dataSize));
+
+		createImage(texture.width, texture.height, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, 
 			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
 
-		transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-		copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-
-		//transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		generateMipmaps(textureImage, texWidth, texHeight, mipLevels);
+		VkBufferImageCopy region = {};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = {
+			texture.width,
+			texture.height,
+			1
+		};
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		// Blits need a graphics queue, so the mip chain is built after the ownership acquire
+		pendingUploads->copyImage(staging, textureImage, mipLevels, { region }, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		generateMipmaps(pendingUploads->graphicsCommands(), textureImage, texture.width, texture.height, mipLevels);
 	}
 
-	void generateMipmaps(VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	// Stages a complete mip chain with one copy and uploads every level in a single
+	// vkCmdCopyBufferToImage, so no blits or per-level barriers are needed. Compressed levels are
+	// copied as whole blocks
+	void uploadTexture(const TextureView& texture) {
+		mipLevels = static_cast<uint32_t>(texture.levels.size());
+
+		std::vector<TextureLevel> uncompressedLevels;
+		uint64_t uncompressedSize = layoutMipChain(texture.width, texture.height, VK_FORMAT_R8G8B8A8_UNORM, uncompressedLevels);
+		std::cout << "texture: " << texture.width << "x" << texture.height << " " << getTextureFormatName(texture.format) << ", "
+			<< mipLevels << " levels, " << texture.dataSize << " bytes (" << uncompressedSize << " bytes as rgba8)" << std::endl;
+
+		StagingRegion staging = pendingUploads->allocateStaging(texture.dataSize);
+		memcpy(staging.mapped, texture.data, static_cast<size_t>(texture.dataSize));
+
+		createImage(texture.width, texture.height, mipLevels, texture.format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+
+		std::vector<VkBufferImageCopy> regions(mipLevels);
+		for (uint32_t i = 0; i < mipLevels; i++) {
+			VkBufferImageCopy& region = regions[i];
+			region = {};
+			region.bufferOffset = texture.levels[i].offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = i;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { texture.levels[i].width, texture.levels[i].height, 1 };
+		}
 
+		pendingUploads->copyImage(staging, textureImage, mipLevels, regions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
 		VkImageMemoryBarrier barrier = {};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
@@ -906,9 +1909,6 @@ private:
 			0, nullptr,
 			0, nullptr,
 			1, &barrier);
-
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
@@ -931,7 +1931,7 @@ private:
 	}
 
 	void createTextureImageView() {
-		textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+		textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
 	}
 
 	void createTextureSampler() {
@@ -958,7 +1958,7 @@ private:
 		}
 	}
 
-	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory) {
 		VkImageCreateInfo imageInfo = {};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -981,16 +1981,10 @@ private:
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate image memory!");
-		}
+		AllocationKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? AllocationKind::Optimal : AllocationKind::Linear;
+		imageMemory = memoryAllocator.allocate(memRequirements, properties, kind);
 
-		vkBindImageMemory(device, image, imageMemory, 0);
+		vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 	}
 
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
@@ -1059,40 +2053,58 @@ private:
 		endSingleTimeCommands(commandBuffer);
 	}
 
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	MeshLayout getVertexLayout() const {
+		return options.compactVertices ? CompactVertexLayout::getMeshLayout() : FullVertexLayout::getMeshLayout();
+	}
 
-		VkBufferImageCopy region = {};
-		region.bufferOffset = 0;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-		region.imageSubresource.layerCount = 1;
-		region.imageOffset = { 0, 0, 0 };
-		region.imageExtent = {
-			width,
-			height,
-			1
-		};
+	void loadModel() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+		MeshLayout layout = getVertexLayout();
+		std::string cachePath = MODEL_PATH + (options.compactVertices ? ".compact" : "") + (options.clusterCulling ? ".meshlets" : "") + MESH_CACHE_SUFFIX;
+
+		bool cached = options.useMeshCache && meshCache.open(cachePath, MODEL_PATH, layout);
+		if (cached) {
+			mesh = meshCache.getView();
+		}
+		else {
+			importModel();
+		}
 
-		vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		computeMeshBounds();
 
-		endSingleTimeCommands(commandBuffer);
+		auto endTime = std::chrono::high_resolution_clock::now();
+		modelLog.out << "model: " << (cached ? "loaded from " + cachePath : "imported " + MODEL_PATH) << " in "
+			<< std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count() << " ms" << std::endl;
+
+		if (!cached && options.useMeshCache && !MeshCache::write(cachePath, MODEL_PATH, layout, mesh)) {
+			modelLog.err << "model: failed to write mesh cache " << cachePath << std::endl;
+		}
 	}
 
-	void loadModel() {
+	// Bounding sphere through the corners of the bounding box recorded at import
+	void computeMeshBounds() {
+		glm::vec3 minimum(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+		glm::vec3 maximum(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+
+		meshBoundingSphere = glm::vec4((minimum + maximum) * 0.5f, 0.5f * glm::length(maximum - minimum));
+	}
+
+	void importModel() {
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
 		std::string err;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str())) {
+		if (!LoadObjParallel(&attrib, &shapes, &err, MODEL_PATH.c_str(), options.loaderThreads)) {
 			throw std::runtime_error(err);
 		}
 
-		std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+		size_t cornerCount = 0;
+		for (const auto& shape : shapes) {
+			cornerCount += shape.mesh.indices.size();
+		}
+
+		std::vector<Vertex> corners;
+		corners.reserve(cornerCount);
 
 		for (const auto& shape : shapes) {
 			for (const auto& index : shape.mesh.indices) {
@@ -1111,74 +2123,289 @@ private:
 
 				vertex.color = { 1.0f, 1.0f, 1.0f };
 
-				vertices.push_back(vertex);
+				corners.push_back(vertex);
+			}
+		}
+
+		weldVertices(corners, vertices, indices, options.loaderThreads);
+		optimizeMesh();
+		buildLods();
+		// Meshlet order costs vertex cache hits, so only meshes drawn by cluster are built that way
+		if (options.clusterCulling) {
+			buildClusters();
+		}
+
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(-std::numeric_limits<float>::max());
+		for (const auto& vertex : vertices) {
+			minimum = glm::min(minimum, vertex.pos);
+			maximum = glm::max(maximum, vertex.pos);
+		}
+
+		for (int axis = 0; axis < 3; axis++) {
+			mesh.boundsMin[axis] = minimum[axis];
+			mesh.boundsMax[axis] = maximum[axis];
+		}
+
+		mesh.vertices = vertices.data();
+		mesh.vertexCount = vertices.size();
+		mesh.vertexStride = sizeof(Vertex);
+		mesh.indices = indices.data();
+		mesh.indexCount = indices.size();
+		mesh.sourceCornerCount = corners.size();
+		mesh.meshlets = meshlets.data();
+		mesh.meshletCount = meshlets.size();
+
+		if (options.compactVertices) {
+			compactMesh();
+		}
+	}
+
+	// Converts the imported vertices to CompactVertex, quantizing positions to the mesh bounds
+	void compactMesh() {
+		glm::vec3 minimum(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+		glm::vec3 maximum(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+
+		glm::vec3 scale = maximum - minimum;
+		for (int axis = 0; axis < 3; axis++) {
+			if (!(scale[axis] > 0.0f)) {
+				scale[axis] = 1.0f;
+			}
+			mesh.positionScale[axis] = scale[axis];
+			mesh.positionOffset[axis] = minimum[axis];
+		}
+
+		compactVertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			glm::vec3 normalized = (vertices[i].pos - minimum) / scale;
+			CompactVertex& compact = compactVertices[i];
+			compact.pos[0] = quantizeUnorm16(normalized.x);
+			compact.pos[1] = quantizeUnorm16(normalized.y);
+			compact.pos[2] = quantizeUnorm16(normalized.z);
+			compact.pos[3] = 0;
+			compact.texCoord[0] = floatToHalf(vertices[i].texCoord.x);
+			compact.texCoord[1] = floatToHalf(vertices[i].texCoord.y);
+		}
+
+		mesh.vertices = compactVertices.data();
+		mesh.vertexStride = sizeof(CompactVertex);
+
+		std::vector<Vertex>().swap(vertices);
+	}
+
+	// Reorders triangles for the post-transform cache and overdraw, then vertices for fetch locality
+	void optimizeMesh() {
+		if (indices.empty()) {
+			return;
+		}
+
+		VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+		std::vector<uint32_t> clusters = optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertices.size());
+		optimizeOverdraw(indices.data(), indices.size(), clusters, &vertices[0].pos, sizeof(Vertex));
+		vertices.resize(optimizeVertexFetch(vertices.data(), indices.data(), indices.size(), vertices.size(), sizeof(Vertex)));
+
+		VertexCacheStats after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+		modelLog.out << "mesh optimizer: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+			<< " (" << VERTEX_CACHE_SIZE << " entry FIFO, " << clusters.size() << " clusters)" << std::endl;
+	}
+
+	// Appends coarser copies of the optimized index list, each simplified from the one before to half
+	// its triangles, until MAX_MESH_LODS levels or the simplifier stops making progress
+	void buildLods() {
+		mesh.lodCount = 1;
+		mesh.lods[0] = { 0, static_cast<uint32_t>(indices.size()), 0.0f, 0, 0 };
+
+		std::vector<uint32_t> lodIndices;
+		while (mesh.lodCount < MAX_MESH_LODS) {
+			MeshLod previous = mesh.lods[mesh.lodCount - 1];
+			size_t targetIndexCount = previous.indexCount / 6 * 3;
+			if (targetIndexCount < LOD_MIN_TRIANGLES * 3) {
+				break;
+			}
+
+			lodIndices.resize(previous.indexCount);
+			float collapseError;
+			size_t indexCount = simplifyMesh(lodIndices.data(), &indices[previous.firstIndex], previous.indexCount, &vertices[0].pos, vertices.size(),
+				sizeof(Vertex), targetIndexCount, std::numeric_limits<float>::max(), &collapseError);
+
+			// A level that saves little is not worth its indices
+			if (indexCount == 0 || indexCount > previous.indexCount / 4 * 3) {
+				break;
+			}
+
+			optimizeVertexCache(lodIndices.data(), lodIndices.data(), indexCount, vertices.size());
+
+			// Collapse errors are measured against the previous level, so they add up along the chain
+			mesh.lods[mesh.lodCount++] = { static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(indexCount), previous.error + collapseError, 0, 0 };
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.begin() + indexCount);
+		}
+
+		modelLog.out << "lod: " << mesh.lodCount << " level(s)";
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			modelLog.out << (lod == 0 ? " of " : ", ") << mesh.lods[lod].indexCount / 3 << " triangles (error " << mesh.lods[lod].error << ")";
+		}
+		modelLog.out << std::endl;
+	}
+
+	// Reorders every level of detail into meshlets, whose bounds let the cluster culling stage reject
+	// parts of the mesh. Meshlet growth order is poor for the vertex cache, so the triangles of each
+	// meshlet are then reordered for it again within the meshlet's index range
+	void buildClusters() {
+		VertexCacheStats before = analyzeVertexCache(indices.data(), mesh.lods[0].indexCount, vertices.size());
 
-				if (uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
+		meshlets.clear();
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			MeshLod& level = mesh.lods[lod];
+			std::vector<Meshlet> levelMeshlets = buildMeshlets(&indices[level.firstIndex], &indices[level.firstIndex], level.indexCount,
+				&vertices[0].pos, vertices.size(), sizeof(Vertex));
+
+			level.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+			level.meshletCount = static_cast<uint32_t>(levelMeshlets.size());
+			for (Meshlet& meshlet : levelMeshlets) {
+				meshlet.firstIndex += level.firstIndex;
+				meshlets.push_back(meshlet);
+			}
+		}
+
+		// Tipsify on local vertex numbers, so its per vertex state is sized by the meshlet rather than the mesh
+		std::vector<uint32_t> localVertices(vertices.size(), std::numeric_limits<uint32_t>::max());
+		std::vector<uint32_t> globalVertices;
+		std::vector<uint32_t> localIndices;
+		for (const Meshlet& meshlet : meshlets) {
+			uint32_t* meshletIndices = &indices[meshlet.firstIndex];
+			size_t indexCount = meshlet.triangleCount * 3;
+
+			globalVertices.clear();
+			localIndices.resize(indexCount);
+			for (size_t i = 0; i < indexCount; i++) {
+				uint32_t& local = localVertices[meshletIndices[i]];
+				if (local == std::numeric_limits<uint32_t>::max()) {
+					local = static_cast<uint32_t>(globalVertices.size());
+					globalVertices.push_back(meshletIndices[i]);
 				}
-				indices.push_back(uniqueVertices[vertex]);
+				localIndices[i] = local;
+			}
+
+			optimizeVertexCache(localIndices.data(), localIndices.data(), indexCount, globalVertices.size());
+
+			for (size_t i = 0; i < indexCount; i++) {
+				meshletIndices[i] = globalVertices[localIndices[i]];
+			}
+			for (uint32_t vertex : globalVertices) {
+				localVertices[vertex] = std::numeric_limits<uint32_t>::max();
 			}
 		}
+
+		VertexCacheStats after = analyzeVertexCache(indices.data(), mesh.lods[0].indexCount, vertices.size());
+
+		uint64_t vertexTotal = 0;
+		for (const Meshlet& meshlet : meshlets) {
+			vertexTotal += meshlet.vertexCount;
+		}
+
+		modelLog.out << "meshlets: " << meshlets.size() << " clusters of up to " << MAX_MESHLET_VERTICES << " vertices and " << MAX_MESHLET_TRIANGLES
+			<< " triangles, " << mesh.lods[0].meshletCount << " at full detail, " << (meshlets.empty() ? 0 : vertexTotal / meshlets.size())
+			<< " vertices on average, full detail ACMR " << before.acmr << " -> " << after.acmr << " in meshlet order" << std::endl;
 	}
 
 	void createVertexBuffer() {
-		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+		modelLog.flush();
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		VkDeviceSize bufferSize = mesh.vertexStride * mesh.vertexCount;
 
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		std::cout << "vertex buffer: " << mesh.vertexCount << " vertices welded from " << mesh.sourceCornerCount << " corners, "
+			<< bufferSize << " bytes uploaded (" << mesh.vertexStride * mesh.sourceCornerCount << " bytes unindexed)" << std::endl;
 
 		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
 
-		copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		// Copies straight out of the cache mapping when the mesh was loaded from the cache
+		pendingUploads->uploadBuffer(vertexBuffer, mesh.vertices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 	}
 
 	void createIndexBuffer() {
-		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+		VkDeviceSize bufferSize = sizeof(uint32_t) * mesh.indexCount;
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
 
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, indices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		pendingUploads->uploadBuffer(indexBuffer, mesh.indices, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	}
 
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	void createUniformBuffer() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		// One slice per frame in flight, since command buffers are recorded per frame rather than per image
+		uniformRing.sliceCount = options.framesInFlight;
+		uniformRing.alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+		uniformRing.sliceSize = (UNIFORM_RING_SLICE_SIZE + uniformRing.alignment - 1) & ~(uniformRing.alignment - 1);
 
-		copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+		VkDeviceSize bufferSize = uniformRing.sliceSize * uniformRing.sliceCount;
+		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformRing.buffer, uniformRing.memory);
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		// Host visible allocations stay mapped for their whole lifetime
+		uniformRing.mapped = static_cast<uint8_t*>(uniformRing.memory.mapped);
 	}
 
-	void createUniformBuffer() {
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
+	void createInstanceBuffer() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		// Regions are also bound as storage buffers by the culling pass
+		VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+		instanceRegionSize = (sizeof(InstanceData) * options.instanceCount + alignment - 1) / alignment * alignment;
+
+		VkDeviceSize bufferSize = instanceRegionSize * options.framesInFlight;
+		createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBuffer, instanceBufferMemory);
+	}
+
+	// Only the GPU reads and writes the draw commands, so they live in device local memory
+	void createDrawCommandBuffer() {
+		if (!options.gpuCulling) {
+			return;
+		}
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, DRAW_COMMAND_HEADER_SIZE);
+		VkDeviceSize regionSize = DRAW_COMMAND_HEADER_SIZE + sizeof(VkDrawIndexedIndirectCommand) * options.instanceCount;
+		drawCommandRegionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+		createBuffer(drawCommandRegionSize * options.framesInFlight,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandBufferMemory);
+	}
+
+	void destroyUniformBuffer() {
+		vkDestroyBuffer(device, uniformRing.buffer, nullptr);
+		memoryAllocator.free(uniformRing.memory);
+		uniformRing = UniformRing();
 	}
 
 	void createDescriptorPool() {
-		std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = 1;
+		uint32_t cullSetCount = options.gpuCulling ? options.framesInFlight : 0;
+
+		std::vector<VkDescriptorPoolSize> poolSizes(2);
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = 1 + cullSetCount;
 		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		poolSizes[1].descriptorCount = 1;
 
+		if (cullSetCount > 0) {
+			VkDescriptorPoolSize storageSize = {};
+			storageSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			storageSize.descriptorCount = 2 * cullSetCount;
+			poolSizes.push_back(storageSize);
+		}
+
 		VkDescriptorPoolCreateInfo poolInfo = {};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = 1;
+		poolInfo.maxSets = 1 + cullSetCount;
 
 		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create descriptor pool!");
@@ -1197,8 +2424,59 @@ private:
 			throw std::runtime_error("failed to allocate descriptor set!");
 		}
 
+		writeDescriptorSet();
+
+		if (options.gpuCulling) {
+			createCullDescriptorSets();
+		}
+	}
+
+	// The sets never change: the uniforms are selected through the dynamic offset and the buffers
+	// live as long as the device
+	void createCullDescriptorSets() {
+		std::vector<VkDescriptorSetLayout> layouts(options.framesInFlight, cullDescriptorSetLayout);
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = options.framesInFlight;
+		allocInfo.pSetLayouts = layouts.data();
+
+		cullDescriptorSets.resize(options.framesInFlight);
+		if (vkAllocateDescriptorSets(device, &allocInfo, cullDescriptorSets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate culling descriptor sets!");
+		}
+
+		for (uint32_t frame = 0; frame < options.framesInFlight; frame++) {
+			std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+			bufferInfos[0].buffer = uniformRing.buffer;
+			bufferInfos[0].offset = 0;
+			bufferInfos[0].range = sizeof(CullUniforms);
+			bufferInfos[1].buffer = instanceBuffer;
+			bufferInfos[1].offset = instanceRegionSize * frame;
+			bufferInfos[1].range = sizeof(InstanceData) * options.instanceCount;
+			bufferInfos[2].buffer = drawCommandBuffer;
+			bufferInfos[2].offset = drawCommandRegionSize * frame;
+			bufferInfos[2].range = DRAW_COMMAND_HEADER_SIZE + sizeof(VkDrawIndexedIndirectCommand) * options.instanceCount;
+
+			std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+			for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+				descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[i].dstSet = cullDescriptorSets[frame];
+				descriptorWrites[i].dstBinding = i;
+				descriptorWrites[i].dstArrayElement = 0;
+				descriptorWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[i].descriptorCount = 1;
+				descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+			}
+
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		}
+	}
+
+	void writeDescriptorSet() {
+		// The slice is selected per draw through the dynamic offset
 		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = uniformBuffer;
+		bufferInfo.buffer = uniformRing.buffer;
 		bufferInfo.offset = 0;
 		bufferInfo.range = sizeof(UniformBufferObject);
 
@@ -1213,7 +2491,7 @@ private:
 		descriptorWrites[0].dstSet = descriptorSet;
 		descriptorWrites[0].dstBinding = 0;
 		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptorWrites[0].descriptorCount = 1;
 		descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -1229,7 +2507,7 @@ private:
 			descriptorWrites.data(), 0, nullptr);
 	}
 
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory) {
 		VkBufferCreateInfo bufferInfo = {};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -1243,164 +2521,785 @@ private:
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate buffer memory!");
-		}
+		bufferMemory = memoryAllocator.allocate(memRequirements, properties, AllocationKind::Linear);
 
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+		vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
 	}
 
-	VkCommandBuffer beginSingleTimeCommands() {
-		VkCommandBufferAllocateInfo allocInfo = {};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = commandPool;
-		allocInfo.commandBufferCount = 1;
+	// Creates the timestamp queries of the GPU zones when profiling on a queue that supports them, and
+	// calibrates the GPU clock against the CPU one: a timestamp is written in an otherwise empty
+	// submission, and the CPU times before the submit and after the wait bracket it. The tightest of
+	// a few attempts puts tick 0 on the CPU clock to within half its round trip
+	void createTimestampQueries() {
+		if (!Profiler::isEnabled() && options.frameTimesPath.empty()) {
+			return;
+		}
 
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		uint32_t validBits = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily].timestampValidBits;
+		if (validBits == 0) {
+			std::cout << "profile: the graphics queue has no timestamps, GPU times are disabled" << std::endl;
+			return;
+		}
 
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
 
-		return commandBuffer;
-	}
+		VkQueryPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * GPU_ZONE_COUNT * 2;
 
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-		vkEndCommandBuffer(commandBuffer);
+		if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
 
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
+		uint64_t bestRoundTrip = std::numeric_limits<uint64_t>::max();
+		for (int attempt = 0; attempt < 5; attempt++) {
+			VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+			vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, 1);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 0);
 
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
+			uint64_t before = Profiler::now();
+			endSingleTimeCommands(commandBuffer);
+			uint64_t after = Profiler::now();
 
-		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-	}
+			uint64_t ticks;
+			if (vkGetQueryPoolResults(device, timestampQueryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+				throw std::runtime_error("failed to read calibration timestamp!");
+			}
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+			if (after - before < bestRoundTrip) {
+				bestRoundTrip = after - before;
+				timestampOffset = static_cast<int64_t>(before + (after - before) / 2) - static_cast<int64_t>((ticks & timestampMask) * timestampPeriod);
+			}
+		}
 
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = size;
-		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+		std::cout << "profile: GPU clock calibrated to within " << (bestRoundTrip / 2e6) << " ms" << std::endl;
+	}
 
-		endSingleTimeCommands(commandBuffer);
+	// Query of one end of a GPU zone of a frame in flight
+	uint32_t getTimestampQuery(uint32_t frame, GpuZone zone, bool end) const {
+		return (frame * GPU_ZONE_COUNT + static_cast<uint32_t>(zone)) * 2 + (end ? 1 : 0);
 	}
 
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	void writeTimestamp(VkCommandBuffer commandBuffer, GpuZone zone, bool end) {
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(commandBuffer, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				timestampQueryPool, getTimestampQuery(currentFrame, zone, end));
+		}
+	}
+
+	// Hands the GPU zones of a frame in flight to the profiler and the frame timings. The frame's
+	// fence must have been waited on
+	void collectGpuZones(uint32_t frame) {
+		if (timestampQueryPool == VK_NULL_HANDLE || !timestampsPending[frame]) {
+			return;
+		}
+		timestampsPending[frame] = false;
+
+		uint64_t firstBegin = std::numeric_limits<uint64_t>::max();
+		uint64_t lastEnd = 0;
 
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-			if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
+		for (uint32_t zone = 0; zone < GPU_ZONE_COUNT; zone++) {
+			if (static_cast<GpuZone>(zone) == GpuZone::Cull && !options.gpuCulling) {
+				continue;
 			}
+
+			uint64_t ticks[2];
+			if (vkGetQueryPoolResults(device, timestampQueryPool, getTimestampQuery(frame, static_cast<GpuZone>(zone), false), 2, sizeof(ticks), ticks,
+				sizeof(ticks[0]), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+				continue;
+			}
+
+			uint64_t begin = static_cast<uint64_t>(timestampOffset + static_cast<int64_t>((ticks[0] & timestampMask) * timestampPeriod));
+			uint64_t end = std::max(begin, static_cast<uint64_t>(timestampOffset + static_cast<int64_t>((ticks[1] & timestampMask) * timestampPeriod)));
+			if (Profiler::isEnabled()) {
+				Profiler::recordGpuZone(GPU_ZONE_NAMES[zone], begin, end);
+			}
+
+			firstBegin = std::min(firstBegin, begin);
+			lastEnd = std::max(lastEnd, end);
 		}
 
-		throw std::runtime_error("failed to find suitable memory type!");
+		uint64_t number = timestampFrameNumbers[frame];
+		if (number < frameTimings.size() && lastEnd >= firstBegin) {
+			frameTimings[number].gpuMilliseconds = (lastEnd - firstBegin) / 1e6;
+		}
 	}
 
-	void createCommandBuffers() {
-		commandBuffers.resize(swapChainFramebuffers.size());
-
+	VkCommandBuffer beginSingleTimeCommands() {
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		return commandBuffer;
+	}
+
+	void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(graphicsQueue);
 
-		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	}
+
+	// Splits the index range of every level of detail into options.sceneDrawCount draws of whole
+	// triangles. With GPU culling the draws come from the culling pass instead, which picks the level
+	// and draws its whole range per instance
+	void createSceneDraws() {
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			uint32_t triangleCount = mesh.lods[lod].indexCount / 3;
+			uint32_t drawCount = options.gpuCulling ? 1 : std::max(1u, std::min(options.sceneDrawCount, triangleCount));
+
+			lodDrawRanges[lod].clear();
+			lodDrawRanges[lod].reserve(drawCount);
+			for (uint32_t i = 0; i < drawCount; i++) {
+				uint32_t firstTriangle = static_cast<uint32_t>(uint64_t(triangleCount) * i / drawCount);
+				uint32_t lastTriangle = static_cast<uint32_t>(uint64_t(triangleCount) * (i + 1) / drawCount);
+				lodDrawRanges[lod].push_back({ mesh.lods[lod].firstIndex + firstTriangle * 3, (lastTriangle - firstTriangle) * 3, 0, 0 });
+			}
+		}
+	}
+
+	// Pairs the index ranges of every level of detail with the instances drawn at that level this frame
+	void updateSceneDraws(const uint32_t firstInstances[], const uint32_t instanceCounts[]) {
+		sceneDraws.clear();
+
+		uint64_t triangleCount = 0;
+		for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+			if (instanceCounts[lod] == 0) {
+				continue;
+			}
+
+			if (options.clusterCulling) {
+				cullClusters(lod, firstInstances[lod], instanceCounts[lod]);
+				continue;
+			}
+
+			for (SceneDraw draw : lodDrawRanges[lod]) {
+				draw.firstInstance = firstInstances[lod];
+				draw.instanceCount = instanceCounts[lod];
+				sceneDraws.push_back(draw);
+			}
+		}
+
+		for (const SceneDraw& draw : sceneDraws) {
+			triangleCount += uint64_t(draw.indexCount / 3) * draw.instanceCount;
+		}
+
+		// The culling pass decides what is drawn on the GPU, out of every instance at full detail
+		if (!options.gpuCulling) {
+			for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+				lodInstanceTotals[lod] += instanceCounts[lod];
+			}
+		}
+		submittedTriangleTotal += triangleCount;
+		submittedFrameCount++;
+	}
+
+	void createFrameCommands() {
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+		recordPool.reset(new ThreadPool(options.recordThreads));
+		uint32_t recorderCount = recordPool->getThreadCount();
+
+		// Buffers are re-recorded every frame, which the transient hint lets the driver allocate for
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+		frameCommands.resize(options.framesInFlight);
+		for (auto& frame : frameCommands) {
+			frame.primary = allocateFrameCommandBuffer(poolInfo, VK_COMMAND_BUFFER_LEVEL_PRIMARY, frame.primaryPool);
+
+			frame.secondaryPools.resize(recorderCount);
+			frame.secondaries.resize(recorderCount);
+			for (uint32_t i = 0; i < recorderCount; i++) {
+				frame.secondaries[i] = allocateFrameCommandBuffer(poolInfo, VK_COMMAND_BUFFER_LEVEL_SECONDARY, frame.secondaryPools[i]);
+			}
+		}
+	}
+
+	VkCommandBuffer allocateFrameCommandBuffer(const VkCommandPoolCreateInfo& poolInfo, VkCommandBufferLevel level, VkCommandPool& pool) {
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create frame command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool;
+		allocInfo.level = level;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
 
-		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo = {};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		return commandBuffer;
+	}
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
+	// Destroying a pool frees the command buffers allocated from it
+	void destroyFrameCommands() {
+		for (auto& frame : frameCommands) {
+			vkDestroyCommandPool(device, frame.primaryPool, nullptr);
+			for (auto pool : frame.secondaryPools) {
+				vkDestroyCommandPool(device, pool, nullptr);
 			}
+		}
+		frameCommands.clear();
+
+		recordPool.reset();
+	}
 
-			VkRenderPassBeginInfo renderPassInfo = {};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = swapChainExtent;
+	// Records the current frame's command buffers for the framebuffer at imageIndex. The scene draws
+	// are split into one secondary command buffer per recording thread, recorded in parallel and
+	// executed by the primary inside the render pass. The frame's fence must have been waited on
+	void recordFrameCommands(uint32_t imageIndex) {
+		PROFILE_ZONE("recordFrameCommands");
+		auto startTime = std::chrono::high_resolution_clock::now();
 
-			std::array<VkClearValue, 2> clearValues = {};
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
+		FrameCommands& frame = frameCommands[currentFrame];
+		// The culled draws are all indirect and belong in exactly one secondary
+		size_t recorderCount = options.gpuCulling ? 1 : std::min(frame.secondaries.size(), sceneDraws.size());
+		uint32_t uniformOffset = static_cast<uint32_t>(uniformRing.sliceOffset(currentFrame) + SCENE_UNIFORM_OFFSET);
 
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
 
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordPool->run(recorderCount, [&](size_t recorder) {
+			PROFILE_ZONE("recordSceneDraws");
+			vkResetCommandPool(device, frame.secondaryPools[recorder], 0);
 
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+			size_t firstDraw = sceneDraws.size() * recorder / recorderCount;
+			size_t lastDraw = sceneDraws.size() * (recorder + 1) / recorderCount;
+			recordSceneDraws(frame.secondaries[recorder], inheritanceInfo, uniformOffset, firstDraw, lastDraw);
+		});
 
-			VkBuffer vertexBuffers[] = { vertexBuffer };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+		vkResetCommandPool(device, frame.primaryPool, 0);
 
-			vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(frame.primary, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
+
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(frame.primary, timestampQueryPool, getTimestampQuery(currentFrame, GpuZone::Cull, false), GPU_ZONE_COUNT * 2);
+			timestampsPending[currentFrame] = true;
+			timestampFrameNumbers[currentFrame] = frameNumber;
+		}
+
+		if (options.gpuCulling) {
+			writeTimestamp(frame.primary, GpuZone::Cull, false);
+			recordCulling(frame.primary);
+			writeTimestamp(frame.primary, GpuZone::Cull, true);
+		}
+
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
+
+		std::array<VkClearValue, 2> clearValues = {};
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		writeTimestamp(frame.primary, GpuZone::RenderPass, false);
+		vkCmdBeginRenderPass(frame.primary, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		// Nothing is recorded when every instance was culled
+		if (recorderCount > 0) {
+			vkCmdExecuteCommands(frame.primary, static_cast<uint32_t>(recorderCount), frame.secondaries.data());
+		}
+
+		vkCmdEndRenderPass(frame.primary);
+		writeTimestamp(frame.primary, GpuZone::RenderPass, true);
+
+		if (vkEndCommandBuffer(frame.primary) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		recordMilliseconds += std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count();
+		recordedFrameCount++;
+	}
+
+	// Records the compute pass that culls the instances of the current frame and writes its draw commands
+	void recordCulling(VkCommandBuffer commandBuffer) {
+		VkDeviceSize regionOffset = drawCommandRegionSize * currentFrame;
+
+		// The previous use of the region was drawn by this frame's last submission, which has finished
+		vkCmdFillBuffer(commandBuffer, drawCommandBuffer, regionOffset, DRAW_COMMAND_HEADER_SIZE, 0);
+
+		VkBufferMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		clearBarrier.buffer = drawCommandBuffer;
+		clearBarrier.offset = regionOffset;
+		clearBarrier.size = DRAW_COMMAND_HEADER_SIZE;
 
-			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &clearBarrier, 0, nullptr);
 
-			vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		uint32_t uniformOffset = static_cast<uint32_t>(uniformRing.sliceOffset(currentFrame) + cullUniformOffset);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[currentFrame], 1, &uniformOffset);
+		vkCmdDispatch(commandBuffer, (options.instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
 
-			vkCmdEndRenderPass(commandBuffers[i]);
+		VkBufferMemoryBarrier commandBarrier = clearBarrier;
+		commandBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		commandBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		commandBarrier.size = drawCommandRegionSize;
 
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1, &commandBarrier, 0, nullptr);
+	}
+
+	// Draws the commands written by recordCulling
+	void recordCulledDraws(VkCommandBuffer commandBuffer) {
+		VkDeviceSize countOffset = drawCommandRegionSize * currentFrame;
+		VkDeviceSize commandOffset = countOffset + DRAW_COMMAND_HEADER_SIZE;
+		uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+		if (cmdDrawIndexedIndirectCount != nullptr) {
+			cmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffer, commandOffset, drawCommandBuffer, countOffset, options.instanceCount, stride);
+		}
+		else if (multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, commandOffset, options.instanceCount, stride);
+		}
+		else {
+			for (uint32_t i = 0; i < options.instanceCount; i++) {
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, commandOffset + stride * i, 1, stride);
 			}
 		}
 	}
 
-	void createSemaphores() {
+	// Records sceneDraws[firstDraw, lastDraw) into a secondary command buffer. Secondary command
+	// buffers inherit no state, so each one binds everything it draws with
+	void recordSceneDraws(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo& inheritanceInfo, uint32_t uniformOffset,
+		size_t firstDraw, size_t lastDraw) {
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+		VkViewport viewport = {};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = (float)swapChainExtent.width;
+		viewport.height = (float)swapChainExtent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		VkBuffer vertexBuffers[] = { vertexBuffer, instanceBuffer };
+		VkDeviceSize offsets[] = { 0, instanceRegionSize * currentFrame };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &uniformOffset);
+
+		if (options.gpuCulling) {
+			recordCulledDraws(commandBuffer);
+		}
+		else {
+			for (size_t i = firstDraw; i < lastDraw; i++) {
+				vkCmdDrawIndexed(commandBuffer, sceneDraws[i].indexCount, sceneDraws[i].instanceCount, sceneDraws[i].firstIndex, 0, sceneDraws[i].firstInstance);
+			}
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
+
+	void createSyncObjects() {
+		imageAvailableSemaphores.resize(options.framesInFlight);
+		renderFinishedSemaphores.resize(options.framesInFlight);
+		inFlightFences.resize(options.framesInFlight);
+		imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS) {
+		// Created signaled so the first wait on each frame returns immediately
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		for (uint32_t i = 0; i < options.framesInFlight; i++) {
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+				vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
 
-			throw std::runtime_error("failed to create semaphores!");
+				throw std::runtime_error("failed to create synchronization objects for a frame!");
+			}
 		}
 	}
 
-	void updateUniformBuffer() {
+	// Seconds since the first frame, driving every animation. With a fixed timestep every frame
+	// advances the same amount, so runs animate identically however long their frames take
+	float getAnimationTime() {
+		if (options.fixedTimestep > 0.0f) {
+			return static_cast<float>(frameNumber * (options.fixedTimestep / 1000.0));
+		}
+
 		static auto startTime = std::chrono::high_resolution_clock::now();
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
-		float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+		return std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	}
+
+	// Instances per side of the square grid they are laid out on
+	uint32_t getInstanceGridSize() const {
+		return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(options.instanceCount))));
+	}
+
+	// Camera position at an animation time, for a single model. The orbit circles the scene every 20
+	// seconds, moving between 50% and 100% of the fixed camera's distance and height
+	glm::vec3 getCameraPosition(float time) const {
+		if (options.cameraPath == CameraPath::Orbit) {
+			float angle = 0.785398163f + time * 6.28318531f / 20.0f;
+			float distance = 2.83f * (0.75f + 0.25f * std::cos(time * 0.5f));
+			float height = 2.0f * (0.75f + 0.25f * std::sin(time * 0.3f));
+			return glm::vec3(distance * std::cos(angle), distance * std::sin(angle), height);
+		}
+		return glm::vec3(2.0f, 2.0f, 2.0f);
+	}
+
+	// Fills the ring slice of the current frame, whose fence must have been waited on
+	void updateUniformBuffer() {
+		PROFILE_ZONE("updateUniformBuffer");
+		float time = getAnimationTime();
+
+		// Back the camera off (and push the far plane out) until the whole instance grid is in view
+		float viewScale = std::max(1.0f, getInstanceGridSize() * INSTANCE_SPACING / 4.0f);
+
+		glm::vec3 cameraPosition = getCameraPosition(time) * viewScale;
 
 		UniformBufferObject ubo = {};
 		ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+		ubo.view = glm::lookAt(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f * viewScale, 10.0f * viewScale);
 		ubo.proj[1][1] *= -1;
 
+		frameModel = ubo.model;
+		frameViewProjection = ubo.proj * ubo.view;
+		frameCameraPosition = cameraPosition;
+
+		// An error e at distance d covers e / d * proj[1][1] * height / 2 pixels
+		frameLodScale = std::abs(ubo.proj[1][1]) * 0.5f * swapChainExtent.height / options.lodPixelError;
+		ubo.positionScale = glm::vec4(mesh.positionScale[0], mesh.positionScale[1], mesh.positionScale[2], 0.0f);
+		ubo.positionOffset = glm::vec4(mesh.positionOffset[0], mesh.positionOffset[1], mesh.positionOffset[2], 0.0f);
+
+		uniformRing.beginSlice(currentFrame);
+
 		void* data;
-		vkMapMemory(device, uniformBufferMemory, 0, sizeof(ubo), 0, &data);
+		VkDeviceSize offset = uniformRing.allocate(sizeof(ubo), &data);
+		if (offset != SCENE_UNIFORM_OFFSET) {
+			throw std::logic_error("scene uniforms must be the first allocation in a ring slice!");
+		}
 		memcpy(data, &ubo, sizeof(ubo));
-		vkUnmapMemory(device, uniformBufferMemory);
+
+		if (options.gpuCulling) {
+			CullUniforms cull = {};
+			cull.model = ubo.model;
+			Frustum frustum = extractFrustum(&frameViewProjection[0][0]);
+			memcpy(cull.frustumPlanes, frustum.planes, sizeof(cull.frustumPlanes));
+			cull.boundingSphere = meshBoundingSphere;
+			cull.objectCount = options.instanceCount;
+			cull.indexCount = mesh.lods[0].indexCount;
+			cull.compact = cmdDrawIndexedIndirectCount != nullptr;
+			cull.lodCount = mesh.lodCount;
+			cull.cameraPosition = glm::vec4(cameraPosition, options.lod ? frameLodScale : 0.0f);
+			for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+				uint32_t errorBits;
+				memcpy(&errorBits, &mesh.lods[lod].error, sizeof(errorBits));
+				cull.lods[lod] = glm::uvec4(mesh.lods[lod].firstIndex, mesh.lods[lod].indexCount, errorBits, 0);
+			}
+
+			cullUniformOffset = uniformRing.allocate(sizeof(cull), &data);
+			memcpy(data, &cull, sizeof(cull));
+		}
+	}
+
+	// Writes the current frame's region of the instance buffer, whose fence must have been waited on,
+	// and the frame's scene draws. Every instance sits on its grid cell, bobbing and turned by its own
+	// phase, and keeps its tint. With CPU culling only the visible instances are written, and with
+	// level of detail they are grouped by level
+	void updateInstanceBuffer() {
+		PROFILE_ZONE("updateInstanceBuffer");
+		float time = getAnimationTime();
+		uint32_t gridSize = getInstanceGridSize();
+		float gridOrigin = -0.5f * (gridSize - 1) * INSTANCE_SPACING;
+
+		// Instances that are culled or reordered are generated aside and packed into the region after
+		InstanceData* region = reinterpret_cast<InstanceData*>(static_cast<uint8_t*>(instanceBufferMemory.mapped) + instanceRegionSize * currentFrame);
+		bool packed = options.cpuCulling || options.clusterCulling || (options.lod && !options.gpuCulling);
+
+		InstanceData* instances = region;
+		if (packed) {
+			sceneInstances.resize(options.instanceCount);
+			instances = sceneInstances.data();
+		}
+
+		for (uint32_t i = 0; i < options.instanceCount; i++) {
+			// Cheap integer hash for a stable per-instance phase and color
+			uint32_t hash = (i + 1) * 2654435761u;
+			float phase = (hash >> 8) / 16777216.0f * 6.28318531f;
+
+			glm::vec3 position(gridOrigin + (i % gridSize) * INSTANCE_SPACING, gridOrigin + (i / gridSize) * INSTANCE_SPACING, 0.05f * std::sin(2.0f * time + phase));
+
+			InstanceData instance;
+			instance.model = glm::rotate(glm::translate(glm::mat4(1.0f), position), phase, glm::vec3(0.0f, 0.0f, 1.0f));
+			instance.tint = options.instanceCount == 1 ? glm::vec4(1.0f) :
+				glm::vec4(0.5f + (hash & 0xFF) / 510.0f, 0.5f + ((hash >> 8) & 0xFF) / 510.0f, 0.5f + ((hash >> 16) & 0xFF) / 510.0f, 1.0f);
+			instances[i] = instance;
+		}
+
+		uint32_t firstInstances[MAX_MESH_LODS] = {};
+		uint32_t instanceCounts[MAX_MESH_LODS] = { options.instanceCount };
+
+		if (options.cpuCulling) {
+			cullInstances();
+		}
+		if (packed) {
+			packInstances(region, firstInstances, instanceCounts);
+		}
+
+		updateSceneDraws(firstInstances, instanceCounts);
+	}
+
+	// Tests the meshlets of a level of detail for each of its instances in the instance buffer region
+	// against the view frustum and their normal cones, and appends a draw of that instance for every
+	// run of adjacent surviving meshlets. The tests run in model space: the instance transforms are
+	// rigid, so the camera and the planes are moved into it instead of moving every meshlet out
+	void cullClusters(uint32_t lod, uint32_t firstInstance, uint32_t instanceCount) {
+		PROFILE_ZONE("cullClusters");
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		Frustum frustum = extractFrustum(&frameViewProjection[0][0]);
+		const MeshLod& level = mesh.lods[lod];
+		const Meshlet* levelMeshlets = mesh.meshlets + level.firstMeshlet;
+
+		for (uint32_t slot = firstInstance; slot < firstInstance + instanceCount; slot++) {
+			glm::mat4 world = sceneInstances[packedInstances[slot]].model * frameModel;
+			glm::vec3 translation(world[3]);
+			glm::vec3 axes[3] = { glm::vec3(world[0]), glm::vec3(world[1]), glm::vec3(world[2]) };
+
+			// The inverse rotation is the transpose, i.e. projecting onto the world space model axes
+			glm::vec3 cameraOffset = frameCameraPosition - translation;
+			glm::vec3 camera(glm::dot(axes[0], cameraOffset), glm::dot(axes[1], cameraOffset), glm::dot(axes[2], cameraOffset));
+
+			glm::vec4 planes[6];
+			for (int i = 0; i < 6; i++) {
+				glm::vec3 normal(frustum.planes[i][0], frustum.planes[i][1], frustum.planes[i][2]);
+				planes[i] = glm::vec4(glm::dot(axes[0], normal), glm::dot(axes[1], normal), glm::dot(axes[2], normal),
+					frustum.planes[i][3] + glm::dot(normal, translation));
+			}
+
+			bool extending = false;
+			for (uint32_t m = 0; m < level.meshletCount; m++) {
+				const Meshlet& meshlet = levelMeshlets[m];
+				glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+				bool inside = true;
+				for (int i = 0; i < 6 && inside; i++) {
+					inside = glm::dot(glm::vec3(planes[i]), center) + planes[i].w >= -meshlet.radius;
+				}
+
+				glm::vec3 apexOffset = glm::vec3(meshlet.coneApex[0], meshlet.coneApex[1], meshlet.coneApex[2]) - camera;
+				glm::vec3 coneAxis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+				bool backfacing = inside && glm::dot(apexOffset, coneAxis) >= meshlet.coneCutoff * glm::length(apexOffset);
+
+				clusterOutsideTotal += !inside;
+				clusterBackfacingTotal += backfacing;
+
+				if (!inside || backfacing) {
+					extending = false;
+				}
+				else if (extending) {
+					sceneDraws.back().indexCount += meshlet.triangleCount * 3;
+				}
+				else {
+					sceneDraws.push_back({ meshlet.firstIndex, meshlet.triangleCount * 3, slot, 1 });
+					extending = true;
+				}
+			}
+			clusterTestedTotal += level.meshletCount;
+		}
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+		clusterCullMilliseconds += std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count();
+	}
+
+	// Copies the instances to draw (the visible ones with CPU culling, otherwise all) into region,
+	// grouped by level of detail from full detail down
+	void packInstances(InstanceData* region, uint32_t firstInstances[], uint32_t instanceCounts[]) {
+		uint32_t drawnCount = options.cpuCulling ? static_cast<uint32_t>(visibleInstances.size()) : options.instanceCount;
+		auto instanceAt = [&](uint32_t i) {
+			return options.cpuCulling ? visibleInstances[i] : i;
+		};
+
+		std::fill(instanceCounts, instanceCounts + MAX_MESH_LODS, 0);
+		instanceLods.resize(drawnCount);
+		packedInstances.resize(drawnCount);
+		for (uint32_t i = 0; i < drawnCount; i++) {
+			uint32_t lod = options.lod ? selectLod(sceneInstances[instanceAt(i)].model) : 0;
+			instanceLods[i] = lod;
+			instanceCounts[lod]++;
+		}
+
+		uint32_t cursors[MAX_MESH_LODS];
+		for (uint32_t lod = 0, first = 0; lod < MAX_MESH_LODS; lod++) {
+			firstInstances[lod] = cursors[lod] = first;
+			first += instanceCounts[lod];
+		}
+
+		for (uint32_t i = 0; i < drawnCount; i++) {
+			uint32_t slot = cursors[instanceLods[i]]++;
+			packedInstances[slot] = instanceAt(i);
+			region[slot] = sceneInstances[packedInstances[slot]];
+		}
+	}
+
+	// Coarsest level of detail whose error projects to at most options.lodPixelError pixels from the
+	// side of the instance's bounding sphere nearest to the camera
+	uint32_t selectLod(const glm::mat4& instanceModel) const {
+		glm::vec3 center = glm::vec3(instanceModel * frameModel * glm::vec4(glm::vec3(meshBoundingSphere), 1.0f));
+		float distance = std::max(glm::length(center - frameCameraPosition) - meshBoundingSphere.w, 0.0f);
+
+		uint32_t lod = 0;
+		while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * frameLodScale <= distance) {
+			lod++;
+		}
+		return lod;
+	}
+
+	// Updates the world bounds of every instance, refits the scene BVH to them (building it on the
+	// first frame) and collects the visible instances
+	void cullInstances() {
+		PROFILE_ZONE("cullInstances");
+		Aabb meshBounds;
+		memcpy(meshBounds.min, mesh.boundsMin, sizeof(meshBounds.min));
+		memcpy(meshBounds.max, mesh.boundsMax, sizeof(meshBounds.max));
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+
+		sceneBounds.resize(sceneInstances.size());
+		for (size_t i = 0; i < sceneInstances.size(); i++) {
+			glm::mat4 world = sceneInstances[i].model * frameModel;
+			sceneBounds[i] = transformAabb(meshBounds, &world[0][0]);
+		}
+
+		if (sceneBvh.getObjectCount() != sceneBounds.size()) {
+			sceneBvh.build(sceneBounds);
+		}
+		else {
+			sceneBvh.refit(sceneBounds);
+		}
+
+		auto refitTime = std::chrono::high_resolution_clock::now();
+
+		CullStats stats;
+		visibleInstances.clear();
+		sceneBvh.cull(extractFrustum(&frameViewProjection[0][0]), visibleInstances, stats);
+
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		cullRefitMilliseconds += std::chrono::duration<double, std::chrono::milliseconds::period>(refitTime - startTime).count();
+		cullTraversalMilliseconds += std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - refitTime).count();
+		cullVisibleTotal += stats.visibleCount;
+		cullCulledTotal += stats.culledCount;
+		cullBoxesTestedTotal += stats.boxesTested;
+		culledFrameCount++;
+	}
+
+	// Waits for the current frame in flight to be reusable and hands its finished zones to the profiler
+	void waitForFrame() {
+		{
+			PROFILE_ZONE("waitForFrame");
+			vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		collectUploads();
+		collectGpuZones(currentFrame);
+
+		if (Profiler::isEnabled()) {
+			Profiler::collect();
+		}
+	}
+
+	// Ends the frame started at frameStart, whose CPU work began at cpuStart
+	void finishFrame(uint64_t frameStart, uint64_t cpuStart) {
+		if (!options.frameTimesPath.empty()) {
+			frameTimings.push_back({ frameStart, (Profiler::now() - cpuStart) / 1e6, -1.0 });
+		}
+
+		frameNumber++;
+		currentFrame = (currentFrame + 1) % options.framesInFlight;
 	}
 
 	void drawFrame() {
+		PROFILE_ZONE("drawFrame");
+		uint64_t frameStart = Profiler::now();
+		waitForFrame();
+		uint64_t cpuStart = Profiler::now();
+
 		uint32_t imageIndex;
-		VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+		VkResult result;
+		{
+			PROFILE_ZONE("acquireNextImage");
+			result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			recreateSwapChain();
@@ -1410,24 +3309,39 @@ private:
 			throw std::runtime_error("failed to acquire swap chain image!");
 		}
 
+		// The image may be acquired out of order while an older frame is still rendering to it
+		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+			vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+		updateUniformBuffer();
+		updateInstanceBuffer();
+		recordFrameCommands(imageIndex);
+
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+		submitInfo.pCommandBuffers = &frameCommands[currentFrame].primary;
 
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-			throw std::runtime_error("failed to submit draw command buffer!");
+		vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+		{
+			PROFILE_ZONE("vkQueueSubmit");
+			if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit draw command buffer!");
+			}
 		}
 
 		VkPresentInfoKHR presentInfo = {};
@@ -1442,7 +3356,10 @@ private:
 
 		presentInfo.pImageIndices = &imageIndex;
 
-		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		{
+			PROFILE_ZONE("vkQueuePresentKHR");
+			result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 			recreateSwapChain();
@@ -1451,9 +3368,90 @@ private:
 			throw std::runtime_error("failed to present swap chain image!");
 		}
 
-		if (enableValidationLayers) {
-			vkQueueWaitIdle(presentQueue);
+		finishFrame(frameStart, cpuStart);
+	}
+
+	uint32_t drawHeadlessFrame() {
+		// Each frame in flight owns its offscreen target, so only the frame fence needs waiting on
+		PROFILE_ZONE("drawHeadlessFrame");
+		uint64_t frameStart = Profiler::now();
+		uint32_t imageIndex = currentFrame;
+		waitForFrame();
+		uint64_t cpuStart = Profiler::now();
+
+		updateUniformBuffer();
+		updateInstanceBuffer();
+		recordFrameCommands(imageIndex);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &frameCommands[currentFrame].primary;
+
+		vkResetFences(device, 1, &inFlightFences[currentFrame]);
+
+		{
+			PROFILE_ZONE("vkQueueSubmit");
+			if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit draw command buffer!");
+			}
+		}
+
+		finishFrame(frameStart, cpuStart);
+
+		return imageIndex;
+	}
+
+	void saveOffscreenImage(uint32_t imageIndex, const std::string& filename) {
+		uint32_t width = swapChainExtent.width;
+		uint32_t height = swapChainExtent.height;
+		VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+
+		VkBuffer readbackBuffer;
+		Allocation readbackBufferMemory;
+		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { width, height, 1 };
+
+		// The render pass leaves the image in TRANSFER_SRC_OPTIMAL
+		vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+		endSingleTimeCommands(commandBuffer);
+
+		void* data = readbackBufferMemory.mapped;
+
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open frame dump file!");
 		}
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+
+		const uint8_t* pixels = static_cast<const uint8_t*>(data);
+		std::vector<uint8_t> row(width * 3);
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t* pixel = pixels + (y * width + x) * 4;
+				row[x * 3 + 0] = pixel[0];
+				row[x * 3 + 1] = pixel[1];
+				row[x * 3 + 2] = pixel[2];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+
+		vkDestroyBuffer(device, readbackBuffer, nullptr);
+		memoryAllocator.free(readbackBufferMemory);
 	}
 
 	VkShaderModule createShaderModule(const std::vector<char>& code) {
@@ -1548,8 +3546,9 @@ private:
 
 		bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-		bool swapChainAdequate = false;
-		if (extensionsSupported) {
+		// Offscreen rendering has nothing to present to
+		bool swapChainAdequate = options.headless;
+		if (extensionsSupported && !options.headless) {
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 		}
@@ -1567,6 +3566,7 @@ private:
 		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
+		auto deviceExtensions = getRequiredDeviceExtensions();
 		std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 		for (const auto& extension : availableExtensions) {
@@ -1587,33 +3587,54 @@ private:
 
 		int i = 0;
 		for (const auto& queueFamily : queueFamilies) {
-			if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphicsFamily = i;
-			}
+			// Keep scanning after graphics and present are found to look for a transfer family
+			if (!indices.isComplete()) {
+				if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+					indices.graphicsFamily = i;
+				}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+				// Without a surface the graphics queue doubles as the "present" queue
+				VkBool32 presentSupport = false;
+				if (options.headless) {
+					presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT ? VK_TRUE : VK_FALSE;
+				}
+				else {
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+				}
 
-			if (queueFamily.queueCount > 0 && presentSupport) {
-				indices.presentFamily = i;
+				if (queueFamily.queueCount > 0 && presentSupport) {
+					indices.presentFamily = i;
+				}
 			}
 
-			if (indices.isComplete()) {
-				break;
+			// Prefer a pure DMA family over an async compute one for copies
+			bool transferOnly = (queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0;
+			if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0 &&
+				(queueFamily.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) != 0 &&
+				(indices.transferFamily < 0 || transferOnly)) {
+				indices.transferFamily = i;
 			}
 
 			i++;
 		}
 
+		if (indices.transferFamily < 0) {
+			indices.transferFamily = indices.graphicsFamily;
+		}
+
 		return indices;
 	}
 
 	std::vector<const char*> getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		std::vector<const char*> extensions;
+
+		if (!options.headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (enableValidationLayers) {
 			extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -1622,6 +3643,14 @@ private:
 		return extensions;
 	}
 
+	std::vector<const char*> getRequiredDeviceExtensions() {
+		if (options.headless) {
+			return {};
+		}
+
+		return deviceExtensions;
+	}
+
 	bool checkValidationLayerSupport() {
 		uint32_t layerCount;
 		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -1672,13 +3701,174 @@ private:
 	}
 };
 
-int main() {
-	HelloTriangleApplication app;
+ApplicationOptions parseCommandLine(int argc, char* argv[]) {
+	ApplicationOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--frames" && hasValue) {
+			options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--width" && hasValue) {
+			options.width = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--height" && hasValue) {
+			options.height = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--dump" && hasValue) {
+			options.dumpDirectory = argv[++i];
+		}
+		else if (arg == "--dump-every" && hasValue) {
+			options.dumpInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--frames-in-flight" && hasValue) {
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--memory-stats") {
+			options.printMemoryStats = true;
+		}
+		else if (arg == "--startup-timing") {
+			options.printStartupTiming = true;
+		}
+		else if (arg == "--loader-threads" && hasValue) {
+			options.loaderThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--no-mesh-cache") {
+			options.useMeshCache = false;
+		}
+		else if (arg == "--no-texture-cache") {
+			options.useTextureCache = false;
+		}
+		else if (arg == "--texture-format" && hasValue) {
+			std::string name = argv[++i];
+			options.textureFormat = VK_FORMAT_UNDEFINED;
+			for (const auto& entry : TEXTURE_FORMAT_NAMES) {
+				if (name == entry.name) {
+					options.textureFormat = entry.format;
+				}
+			}
+
+			if (options.textureFormat == VK_FORMAT_UNDEFINED && name != "auto") {
+				throw std::runtime_error("unknown texture format: " + name);
+			}
+		}
+		else if (arg == "--mip-filter" && hasValue) {
+			std::string name = argv[++i];
+			if (name == "box") {
+				options.mipFilter = MipFilter::Box;
+			}
+			else if (name == "kaiser") {
+				options.mipFilter = MipFilter::Kaiser;
+			}
+			else {
+				throw std::runtime_error("unknown mip filter: " + name);
+			}
+		}
+		else if (arg == "--no-pipeline-cache") {
+			options.usePipelineCache = false;
+		}
+		else if (arg == "--serial-startup") {
+			options.concurrentStartup = false;
+		}
+		else if (arg == "--compact-vertices") {
+			options.compactVertices = true;
+		}
+		else if (arg == "--scene-draws" && hasValue) {
+			options.sceneDrawCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--record-threads" && hasValue) {
+			options.recordThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--instances" && hasValue) {
+			options.instanceCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--gpu-culling") {
+			options.gpuCulling = true;
+		}
+		else if (arg == "--cpu-culling") {
+			options.cpuCulling = true;
+		}
+		else if (arg == "--lod") {
+			options.lod = true;
+		}
+		else if (arg == "--lod-error" && hasValue) {
+			options.lodPixelError = std::stof(argv[++i]);
+		}
+		else if (arg == "--cluster-culling") {
+			options.clusterCulling = true;
+		}
+		else if (arg == "--profile") {
+			options.profile = true;
+		}
+		else if (arg == "--profile-trace" && hasValue) {
+			options.profileTracePath = argv[++i];
+			options.profile = true;
+		}
+		else if (arg == "--fixed-timestep" && hasValue) {
+			options.fixedTimestep = std::stof(argv[++i]);
+		}
+		else if (arg == "--camera-path" && hasValue) {
+			std::string name = argv[++i];
+			if (name == "fixed") {
+				options.cameraPath = CameraPath::Fixed;
+			}
+			else if (name == "orbit") {
+				options.cameraPath = CameraPath::Orbit;
+			}
+			else {
+				throw std::runtime_error("unknown camera path: " + name);
+			}
+		}
+		else if (arg == "--frame-times" && hasValue) {
+			options.frameTimesPath = argv[++i];
+		}
+		else {
+			throw std::runtime_error("unknown or incomplete argument: " + arg);
+		}
+	}
+
+	if (options.frameCount == 0 || options.width == 0 || options.height == 0) {
+		throw std::runtime_error("frame count and resolution must be non-zero!");
+	}
+
+	if (options.instanceCount == 0) {
+		throw std::runtime_error("instance count must be non-zero!");
+	}
+
+	if (options.fixedTimestep < 0.0f) {
+		throw std::runtime_error("fixed timestep must not be negative!");
+	}
+
+	if (!(options.lodPixelError > 0.0f)) {
+		throw std::runtime_error("level of detail error must be positive!");
+	}
+
+	if (options.gpuCulling && options.cpuCulling) {
+		throw std::runtime_error("--gpu-culling and --cpu-culling are exclusive!");
+	}
+
+	if (options.gpuCulling && options.clusterCulling) {
+		throw std::runtime_error("--cluster-culling culls on the CPU and cannot be combined with --gpu-culling!");
+	}
+
+	if (options.framesInFlight == 0 || options.framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+		throw std::runtime_error("frames in flight must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT) + "!");
+	}
+
+	return options;
+}
 
+int main(int argc, char* argv[]) {
 	try {
+		HelloTriangleApplication app(parseCommandLine(argc, argv));
 		app.run();
 	}
-	catch (const std::runtime_error& e) {
+	catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}